@@ -7,7 +7,7 @@
 
 #include <string>
 
-typedef unsigned int StorageSize;
+typedef unsigned long long StorageSize;
 
 namespace StorageEstimator
 {
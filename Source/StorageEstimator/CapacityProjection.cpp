@@ -0,0 +1,201 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "CapacityProjection.h"
+#include "ImageVariants.h"
+
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <stdexcept>
+
+namespace StorageEstimator
+{
+	IngestModel IngestModel::FromImageStack(const CombinedImageStack& imageStack)
+	{
+		IngestModel model;
+
+		// Sizes are computed once per sample through the batch path, so drawing an image
+		// during the simulation is a table lookup
+		Image::DescriptionVector descriptions = imageStack.ImageDescriptions();
+		const Image::Type types[] = { Image::Type::JPEG, Image::Type::JPEG2000, Image::Type::BMP };
+		for (auto type : types)
+		{
+			std::vector<Image::Dimension> widths;
+			std::vector<Image::Dimension> heights;
+			for (const auto& description : descriptions)
+			{
+				if (description.type == type)
+				{
+					widths.push_back(description.width);
+					heights.push_back(description.height);
+				}
+			}
+
+			std::vector<StorageSize> sizes(widths.size());
+			Image::EstimateSizes(type, widths.data(), heights.data(), sizes.data(), sizes.size());
+			model.imageSizeSamples.insert(model.imageSizeSamples.end(), sizes.begin(), sizes.end());
+		}
+
+		model.stackImageCountSamples = imageStack.StackImageCounts();
+		if (!model.stackImageCountSamples.empty() && !descriptions.empty())
+		{
+			// A unit is either a single image or a whole stack. For a stacked image fraction f
+			// and mean stack image count k, a unit starts a stack with probability f / (f + k(1 - f)).
+			double stackedImages = (double)std::accumulate(model.stackImageCountSamples.begin(), model.stackImageCountSamples.end(), (size_t)0);
+			double stackedFraction = stackedImages / descriptions.size();
+			double meanImagesPerStack = stackedImages / model.stackImageCountSamples.size();
+			model.stackStartProbability = stackedFraction / (stackedFraction + meanImagesPerStack * (1.0 - stackedFraction));
+		}
+
+		return model;
+	}
+
+	bool IngestModel::IsEmpty() const
+	{
+		return imageSizeSamples.empty();
+	}
+
+	std::string ProjectionResult::ToString() const
+	{
+		std::string output = "\t" + std::to_string(numberOfSimulations) + " simulations, " + std::to_string(imagesSimulated) + " images simulated in " + std::to_string(seconds) + " s\n\n";
+		output += "\tDays\tP5\t\t\tP50\t\t\tP95\n";
+
+		for (const auto& horizon : horizons)
+		{
+			output += "\t" + std::to_string(horizon.days)
+				+ "\t" + StorageSizeToString(horizon.percentile5) + " bytes"
+				+ "\t" + StorageSizeToString(horizon.percentile50) + " bytes"
+				+ "\t" + StorageSizeToString(horizon.percentile95) + " bytes\n";
+		}
+
+		return output;
+	}
+
+	ProjectionResult CapacityProjection::Run(StorageSize startSize, const ProjectionSettings& settings) const
+	{
+		if (model.IsEmpty())
+		{
+			throw std::invalid_argument("The projection needs at least one image to sample the ingest from");
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		ProjectionSettings sortedSettings(settings);
+		auto& horizonDays = sortedSettings.horizonDays;
+		std::sort(horizonDays.begin(), horizonDays.end());
+		horizonDays.erase(std::unique(horizonDays.begin(), horizonDays.end()), horizonDays.end());
+		if (horizonDays.empty() || horizonDays.front() == 0)
+		{
+			throw std::invalid_argument("The projection needs at least one horizon, and horizons must be at least one day");
+		}
+
+		unsigned int numberOfThreads = settings.numberOfThreads;
+		if (numberOfThreads == 0) numberOfThreads = std::max(1u, std::thread::hardware_concurrency());
+		numberOfThreads = std::min(numberOfThreads, std::max(1u, settings.numberOfSimulations));
+
+		// Every simulation writes to its own slot, so threads never share results
+		std::vector<std::vector<StorageSize>> totalsByHorizon(horizonDays.size(), std::vector<StorageSize>(settings.numberOfSimulations));
+		std::vector<unsigned long long> imagesSimulatedByThread(numberOfThreads, 0);
+
+		std::vector<std::thread> threads;
+		for (unsigned int thread = 0; thread < numberOfThreads; ++thread)
+		{
+			threads.emplace_back(&CapacityProjection::SimulateFutures, this, thread, numberOfThreads, startSize, std::cref(sortedSettings), std::ref(totalsByHorizon), std::ref(imagesSimulatedByThread[thread]));
+		}
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		ProjectionResult result;
+		result.numberOfSimulations = settings.numberOfSimulations;
+		result.imagesSimulated = std::accumulate(imagesSimulatedByThread.begin(), imagesSimulatedByThread.end(), 0ull);
+
+		for (size_t horizonIndex = 0; horizonIndex < horizonDays.size(); ++horizonIndex)
+		{
+			auto& totals = totalsByHorizon[horizonIndex];
+			std::sort(totals.begin(), totals.end());
+
+			// Nearest rank percentiles
+			auto percentile = [&totals](double fraction) -> StorageSize {
+				if (totals.empty()) return 0;
+				size_t rank = (size_t)std::ceil(fraction * totals.size());
+				return totals[std::max<size_t>(rank, 1) - 1];
+			};
+
+			HorizonPercentiles horizon;
+			horizon.days = horizonDays[horizonIndex];
+			horizon.percentile5 = percentile(0.05);
+			horizon.percentile50 = percentile(0.50);
+			horizon.percentile95 = percentile(0.95);
+			result.horizons.push_back(horizon);
+		}
+
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		return result;
+	}
+
+	void CapacityProjection::SimulateFutures(unsigned int firstSimulation, unsigned int simulationStep, StorageSize startSize, const ProjectionSettings& settings, std::vector<std::vector<StorageSize>>& totalsByHorizon, unsigned long long& imagesSimulated) const
+	{
+		std::uniform_int_distribution<size_t> drawImage(0, model.imageSizeSamples.size() - 1);
+		std::uniform_int_distribution<size_t> drawStack(0, std::max<size_t>(model.stackImageCountSamples.size(), 1) - 1);
+		std::uniform_real_distribution<double> drawUnit(0.0, 1.0);
+		std::poisson_distribution<unsigned long long> drawDailyIngest(std::max(settings.imagesPerDay, 0.0));
+
+		unsigned long long imageCount = 0;
+
+		for (unsigned int simulation = firstSimulation; simulation < settings.numberOfSimulations; simulation += simulationStep)
+		{
+			// Seeding by simulation index keeps results independent of the thread count
+			std::seed_seq seed = { (unsigned int)settings.seed, (unsigned int)(settings.seed >> 32), simulation };
+			std::mt19937_64 random(seed);
+
+			StorageSize totalSize = startSize;
+			size_t horizonIndex = 0;
+
+			for (unsigned int day = 1; horizonIndex < settings.horizonDays.size(); ++day)
+			{
+				unsigned long long dailyImages = (settings.imagesPerDay > 0.0) ? drawDailyIngest(random) : 0;
+				unsigned long long imagesToday = 0;
+
+				while (imagesToday < dailyImages)
+				{
+					if (model.stackStartProbability > 0.0 && drawUnit(random) < model.stackStartProbability)
+					{
+						size_t stackImageCount = model.stackImageCountSamples[drawStack(random)];
+
+						StorageSize uncompressedSize = 0;
+						for (size_t i = 0; i < stackImageCount; ++i)
+						{
+							uncompressedSize += model.imageSizeSamples[drawImage(random)];
+						}
+
+						totalSize += Image::Stack::CompressedSize(uncompressedSize, stackImageCount);
+						imagesToday += stackImageCount;
+					}
+					else
+					{
+						totalSize += model.imageSizeSamples[drawImage(random)];
+						imagesToday++;
+					}
+				}
+
+				imageCount += imagesToday;
+
+				while (horizonIndex < settings.horizonDays.size() && settings.horizonDays[horizonIndex] == day)
+				{
+					totalsByHorizon[horizonIndex++][simulation] = totalSize;
+				}
+			}
+		}
+
+		imagesSimulated = imageCount;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "CombinedImageStack.h"
+
+namespace StorageEstimator
+{
+	// Daily ingest resampled from the images and stacks already in an estimate
+	struct IngestModel
+	{
+		std::vector<StorageSize> imageSizeSamples;
+		std::vector<size_t> stackImageCountSamples;
+		double stackStartProbability = 0.0;		// per drawn unit, chosen to reproduce the stacked image fraction
+
+		static IngestModel FromImageStack(const CombinedImageStack& imageStack);
+		bool IsEmpty() const;
+	};
+
+	struct ProjectionSettings
+	{
+		double imagesPerDay = 0.0;
+		std::vector<unsigned int> horizonDays;
+		unsigned int numberOfSimulations = 1000;
+		unsigned int numberOfThreads = 0;		// 0 uses all hardware threads
+		unsigned long long seed = 2018;
+	};
+
+	struct HorizonPercentiles
+	{
+		unsigned int days = 0;
+		StorageSize percentile5 = 0;
+		StorageSize percentile50 = 0;
+		StorageSize percentile95 = 0;
+	};
+
+	struct ProjectionResult
+	{
+		std::vector<HorizonPercentiles> horizons;
+		unsigned int numberOfSimulations = 0;
+		unsigned long long imagesSimulated = 0;
+		double seconds = 0.0;
+
+		std::string ToString() const;
+	};
+
+	class CapacityProjection
+	{
+	private:
+		IngestModel model;
+
+	public:
+		CapacityProjection(const IngestModel& ingestModel)
+			: model{ ingestModel }
+		{}
+		~CapacityProjection() = default;
+
+		// Simulates independent futures starting from startSize and reports the spread of
+		// total sizes at each horizon. Throws std::invalid_argument for an empty model.
+		ProjectionResult Run(StorageSize startSize, const ProjectionSettings& settings) const;
+
+	private:
+		void SimulateFutures(unsigned int firstSimulation, unsigned int simulationStep, StorageSize startSize, const ProjectionSettings& settings, std::vector<std::vector<StorageSize>>& totalsByHorizon, unsigned long long& imagesSimulated) const;
+	};
+}
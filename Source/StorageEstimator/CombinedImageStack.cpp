@@ -8,138 +8,408 @@
 #include "CombinedImageStack.h"
 #include "ImageVariants.h"
 
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	template<typename Container>
+	void ReserveGeometrically(Container& container, size_t requiredSize)
+	{
+		// Reserving exactly the required size would reallocate on every batch
+		if (requiredSize > container.capacity())
+		{
+			container.reserve(std::max(requiredSize, 2 * container.capacity()));
+		}
+	}
+}
+
 namespace StorageEstimator
 {
+	std::string StackSummary::ToString() const
+	{
+		return "Stack " + std::to_string(id) + "\t" + std::to_string(numberOfImages) + " images\t" + StorageSizeToString(size) + " bytes";
+	}
+
 	void CombinedImageStack::AddImage(Image::Type imageType, Image::Dimension width, Image::Dimension height)
 	{
-		Stack::AddImage(Image::MakeSharedPtrByType(imageType, ++idCounter, imageType, width, height));
+		Image::SharedPtr image = Image::MakeSharedPtrByType(imageType, ++idCounter, imageType, width, height);
+		locationsById.push_back(ImageLocation{ 0, Stack::AddImage(image) });
+		numberOfImages++;
+		IndexImage(image);
+	}
+
+	Image::Id CombinedImageStack::AddImages(const Image::DescriptionVector& descriptions)
+	{
+		// Ids are handed out sequentially, so the batch occupies [firstId, firstId + size)
+		Image::Id firstId = idCounter + 1;
+
+		ReserveGeometrically(images, images.size() + descriptions.size());
+		ReserveGeometrically(locationsById, locationsById.size() + descriptions.size());
+		for (const auto& description : descriptions)
+		{
+			AddImage(description.type, description.width, description.height);
+		}
+
+		return firstId;
+	}
+
+	void CombinedImageStack::AddStack(const std::vector<Image::Id>& imageIds)
+	{
+		AddStacks({ imageIds });
 	}
 
-	void CombinedImageStack::AddStack(std::vector<Image::Id>& imageIds)
+	void CombinedImageStack::AddStacks(const std::vector<std::vector<Image::Id>>& stacksOfImageIds)
 	{
-		Image::Stack newStack;
+		// Gives the same result as calling AddStack for each list in order, so an image listed
+		// by several stacks ends up in the last one. Every image is moved straight to its final
+		// stack, and each stack it leaves is updated once at the end.
+		std::unordered_map<Image::Id, size_t> targetStackById;
+		for (size_t stackIndex = 0; stackIndex < stacksOfImageIds.size(); ++stackIndex)
+		{
+			for (auto id : stacksOfImageIds[stackIndex])
+			{
+				targetStackById[id] = stackIndex;
+			}
+		}
 
-		// Iterators are used to find / move images around
-		Image::SharedPtrVector::iterator imageLocation;
-		Image::StackVector::iterator imageStackLocation;
+		std::vector<size_t> changedStackIndices;
 
-		for (auto id : imageIds)
-		{ 
-			if (FindImageOutsideStacks(id, imageLocation))
+		for (size_t stackIndex = 0; stackIndex < stacksOfImageIds.size(); ++stackIndex)
+		{
+			Image::Stack newStack(++stackIdCounter);
+
+			for (auto id : stacksOfImageIds[stackIndex])
+			{
+				if (!ContainsImage(id) || targetStackById[id] != stackIndex) continue;
+				if (locationsById[id - 1].stackId == newStack.Id()) continue;
+
+				Image::SharedPtr image = TakeImage(id, changedStackIndices);
+				locationsById[id - 1] = ImageLocation{ newStack.Id(), newStack.AddImage(image) };
+			}
+
+			// Stacks whose images were all taken by later lists are dropped, just like
+			// AddStack drops a stack when its last image is moved away
+			if (newStack.IsEmpty())
 			{
-				MoveImageToStack(imageLocation, newStack);
+				stackIndicesById.push_back(removedStackIndex);
 			}
 			else
 			{
-				if (FindImageInStack(id, imageStackLocation, imageLocation))
-				{
-					Image::Stack& sourceStack = *imageStackLocation;
-					MoveImageBetweenStacks(imageLocation, sourceStack, newStack);
-
-					if (sourceStack.IsEmpty())
-					{
-						imageStacks.erase(imageStackLocation);
-					}
-				}
+				stackIndicesById.push_back(imageStacks.size());
+				IndexStack(newStack);
+				imageStacks.push_back(newStack);
+				numberOfStacks++;
 			}
 		}
 
-		imageStacks.push_back(newStack);
+		FinishChangedStacks(changedStackIndices);
+		CompactIfNeeded();
 	}
 
-	size_t CombinedImageStack::NumberOfImages() const
+	bool CombinedImageStack::RemoveImageById(Image::Id imageId)
+	{
+		if (!ContainsImage(imageId)) return false;
+
+		std::vector<size_t> changedStackIndices;
+		Image::SharedPtr image = TakeImage(imageId, changedStackIndices);
+		FinishChangedStacks(changedStackIndices);
+		numberOfImages--;
+		UnindexImage(image);
+
+		CompactIfNeeded();
+		return true;
+	}
+
+	bool CombinedImageStack::UngroupStack(Image::Id stackId)
+	{
+		// The images of the stack are moved to the end of the images outside stacks
+		if (!ContainsStack(stackId)) return false;
+
+		size_t stackIndex = stackIndicesById[stackId - 1];
+		Image::Stack& stack = imageStacks.MutableAt(stackIndex);
+		UnindexStack(stack);
+
+		stack.ForEachImage([this](const Image::SharedPtr& image) {
+			locationsById[image->Id() - 1] = ImageLocation{ 0, Stack::AddImage(image) };
+		});
+
+		stack = Image::Stack();
+		stackIndicesById[stackId - 1] = removedStackIndex;
+		numberOfStacks--;
+
+		CompactIfNeeded();
+		return true;
+	}
+
+	bool CombinedImageStack::ContainsImage(Image::Id imageId) const
+	{
+		return imageId >= 1 && imageId <= idCounter && locationsById[imageId - 1].index != removedImageIndex;
+	}
+
+	bool CombinedImageStack::ContainsStack(Image::Id stackId) const
+	{
+		return stackId >= 1 && stackId <= stackIdCounter && stackIndicesById[stackId - 1] != removedStackIndex;
+	}
+
+	Image::Id CombinedImageStack::HighestImageId() const
 	{
 		return idCounter;
 	}
 
+	Image::Id CombinedImageStack::HighestStackId() const
+	{
+		return stackIdCounter;
+	}
+
+	void CombinedImageStack::RecomputeSizes()
+	{
+		// Rebuilds every cached size and index, which is needed once the active CostModel changes
+		statisticsByType = {};
+		imagesBySize.Clear();
+		stacksBySize.Clear();
+		compressedStacksSize = 0;
+
+		auto indexImage = [this](const Image::SharedPtr& image) { IndexImage(image); };
+
+		RecomputeSize();
+		ForEachImage(indexImage);
+
+		for (size_t stackIndex = 0; stackIndex < imageStacks.size(); ++stackIndex)
+		{
+			if (imageStacks[stackIndex].IsEmpty()) continue;
+
+			Image::Stack& stack = imageStacks.MutableAt(stackIndex);
+			stack.RecomputeSize();
+			stack.ForEachImage(indexImage);
+			IndexStack(stack);
+		}
+	}
+
+	size_t CombinedImageStack::NumberOfImages() const
+	{
+		return numberOfImages;
+	}
+
 	size_t CombinedImageStack::NumberOfStacks() const
 	{
-		return imageStacks.size();
+		return numberOfStacks;
 	}
 
-	StorageSize CombinedImageStack::Size() const
+	Image::DescriptionVector CombinedImageStack::ImageDescriptions() const
 	{
-		StorageSize totalSize = 0;
-		for (auto &image : images)
+		Image::DescriptionVector descriptions;
+		descriptions.reserve(numberOfImages);
+
+		AppendImageDescriptions(descriptions);
+		for (const auto& stack : imageStacks)
 		{
-			totalSize += image->Size();
+			stack.AppendImageDescriptions(descriptions);
 		}
 
-		for (auto &stack : imageStacks)
+		return descriptions;
+	}
+
+	std::vector<size_t> CombinedImageStack::StackImageCounts() const
+	{
+		std::vector<size_t> imageCounts;
+		imageCounts.reserve(numberOfStacks);
+
+		for (const auto& stack : imageStacks)
 		{
-			totalSize += stack.Size();
+			if (!stack.IsEmpty()) imageCounts.push_back(stack.NumberOfImages());
 		}
 
-		return totalSize;
+		return imageCounts;
+	}
+
+	StorageSize CombinedImageStack::Size() const
+	{
+		// Images outside stacks are not compressed
+		return uncompressedSize + compressedStacksSize;
 	}
 
 	std::string CombinedImageStack::ToString() const
 	{
-		std::string outputString;
+		return TakeSnapshot().ToString();
+	}
+
+	std::string CombinedImageStack::SummaryToString() const
+	{
+		return TakeSnapshot().SummaryToString();
+	}
+
+	ImageStackSnapshot CombinedImageStack::TakeSnapshot() const
+	{
+		// Copies chunk tables only, the images and stacks are shared until either side changes
+		return ImageStackSnapshot(*this, imageStacks, NumberOfImages(), NumberOfStacks(), Size());
+	}
 
-		if (images.size() == 0)
+	const TypeStatistics& CombinedImageStack::StatisticsForType(Image::Type imageType) const
+	{
+		return statisticsByType.at((size_t)imageType);
+	}
+
+	Image::SharedPtrVector CombinedImageStack::LargestImages(size_t count) const
+	{
+		Image::SharedPtrVector largestImages;
+		for (const auto& entry : imagesBySize.Largest(count))
 		{
-			outputString += "\tNo images outside stacks\n";
+			largestImages.push_back(entry.payload);
 		}
-		else
+
+		return largestImages;
+	}
+
+	std::vector<StackSummary> CombinedImageStack::LargestStacks(size_t count) const
+	{
+		std::vector<StackSummary> largestStacks;
+		for (const auto& entry : stacksBySize.Largest(count))
 		{
-			for (const auto& image : images)
-			{
-				outputString += "\t" + image->ToString() + "\n";
-			}
+			largestStacks.push_back(StackSummary{ entry.id, entry.payload, entry.size });
 		}
-		outputString += "\n";
 
+		return largestStacks;
+	}
+
+	static size_t NearestRankFromPercentile(double percentile, size_t count)
+	{
+		// Zero based rank of the smallest entry with at least percentile % of all entries at or below it
+		size_t rank = (size_t)std::ceil(percentile / 100.0 * count);
+		return std::min(std::max<size_t>(rank, 1), count) - 1;
+	}
 
-		if (NumberOfStacks() == 0)
+	bool CombinedImageStack::FindImageAtPercentile(double percentile, Image::SharedPtr& image) const
+	{
+		if (imagesBySize.Count() == 0) return false;
+
+		image = imagesBySize.SelectByRank(NearestRankFromPercentile(percentile, imagesBySize.Count())).payload;
+		return true;
+	}
+
+	bool CombinedImageStack::FindStackAtPercentile(double percentile, StackSummary& stack) const
+	{
+		if (stacksBySize.Count() == 0) return false;
+
+		const auto& entry = stacksBySize.SelectByRank(NearestRankFromPercentile(percentile, stacksBySize.Count()));
+		stack = StackSummary{ entry.id, entry.payload, entry.size };
+		return true;
+	}
+
+	Image::SharedPtr CombinedImageStack::TakeImage(Image::Id imageId, std::vector<size_t>& changedStackIndices)
+	{
+		// Leaves a tombstone where the image was. A stack losing its first image is taken out
+		// of the stack index until FinishChangedStacks, so its size is only recomputed once.
+		ImageLocation& location = locationsById[imageId - 1];
+		Image::SharedPtr image;
+
+		if (location.stackId == 0)
 		{
-			outputString += "\tNo image stacks\n";
+			image = ImageAt(location.index);
+			Stack::RemoveImage(location.index);
 		}
 		else
 		{
-			for (const auto& stack : imageStacks)
+			size_t stackIndex = stackIndicesById[location.stackId - 1];
+			Image::Stack& stack = imageStacks.MutableAt(stackIndex);
+			if (std::find(changedStackIndices.begin(), changedStackIndices.end(), stackIndex) == changedStackIndices.end())
 			{
-				outputString += "\tStack:\n" + stack.ToString() + "\n";
+				UnindexStack(stack);
+				changedStackIndices.push_back(stackIndex);
 			}
+
+			image = stack.ImageAt(location.index);
+			stack.RemoveImage(location.index);
 		}
-		outputString += "\n\tTotal Size: " + StorageSizeToString(Size()) + " bytes\n\n";
 
-		return outputString;
+		location.index = removedImageIndex;
+		return image;
 	}
 
-	bool CombinedImageStack::FindImageOutsideStacks(Image::Id id, Image::SharedPtrVector::iterator& imageLocation)
+	void CombinedImageStack::FinishChangedStacks(const std::vector<size_t>& changedStackIndices)
 	{
-		// returns true and valid iterator on success
-		return Image::FindByIdInVector(images, id, imageLocation);
+		for (auto stackIndex : changedStackIndices)
+		{
+			Image::Stack& stack = imageStacks.MutableAt(stackIndex);
+			if (stack.IsEmpty())
+			{
+				stackIndicesById[stack.Id() - 1] = removedStackIndex;
+				stack = Image::Stack();
+				numberOfStacks--;
+				continue;
+			}
+
+			if (stack.NeedsCompaction())
+			{
+				stack.Compact();
+				for (size_t imageIndex = 0; imageIndex < stack.NumberOfImageSlots(); ++imageIndex)
+				{
+					locationsById[stack.ImageAt(imageIndex)->Id() - 1].index = imageIndex;
+				}
+			}
+
+			IndexStack(stack);
+		}
 	}
 
-	bool CombinedImageStack::FindImageInStack(Image::Id id, Image::StackVector::iterator& parentStack, Image::SharedPtrVector::iterator& imageLocation)
+	void CombinedImageStack::CompactIfNeeded()
 	{
-		// returns true and valid iterator on success
-
-		parentStack = imageStacks.end();
+		// Tombstones are dropped once they outnumber the live entries, so memory and listing
+		// time follow the live images while each removal stays amortized O(1)
+		if (Stack::NeedsCompaction())
+		{
+			Stack::Compact();
+			for (size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex)
+			{
+				locationsById[images[imageIndex]->Id() - 1].index = imageIndex;
+			}
+		}
 
-		for (int index = 0; index<imageStacks.size(); ++index)
+		size_t numberOfRemovedStacks = imageStacks.size() - numberOfStacks;
+		if (numberOfRemovedStacks >= minimumRemovedStacksToCompact && numberOfRemovedStacks > numberOfStacks)
 		{
-			if (imageStacks[index].FindImage(id, imageLocation))
+			Image::StackVector remainingStacks;
+			remainingStacks.reserve(numberOfStacks);
+			for (const auto& stack : imageStacks)
 			{
-				parentStack = imageStacks.begin() + index;
-				return true;
+				if (stack.IsEmpty()) continue;
+
+				stackIndicesById[stack.Id() - 1] = remainingStacks.size();
+				remainingStacks.push_back(stack);
 			}
+			imageStacks = remainingStacks;
 		}
+	}
 
-		return false;
+	void CombinedImageStack::IndexImage(const Image::SharedPtr& image)
+	{
+		StorageSize imageSize = image->Size();
+		TypeStatistics& statistics = statisticsByType[(size_t)image->Describe().type];
+		statistics.numberOfImages++;
+		statistics.totalSize += imageSize;
+		imagesBySize.Insert(imageSize, image->Id(), image);
+	}
+
+	void CombinedImageStack::UnindexImage(const Image::SharedPtr& image)
+	{
+		StorageSize imageSize = image->Size();
+		TypeStatistics& statistics = statisticsByType[(size_t)image->Describe().type];
+		statistics.numberOfImages--;
+		statistics.totalSize -= imageSize;
+		imagesBySize.Erase(imageSize, image->Id());
 	}
 
-	void CombinedImageStack::MoveImageToStack(Image::SharedPtrVector::iterator location, Image::Stack& stack)
+	void CombinedImageStack::IndexStack(const Image::Stack& stack)
 	{
-		stack.AddImage(*location);
-		images.erase(location);
+		StorageSize stackSize = stack.Size();
+		compressedStacksSize += stackSize;
+		stacksBySize.Insert(stackSize, stack.Id(), stack.NumberOfImages());
 	}
 
-	void CombinedImageStack::MoveImageBetweenStacks(Image::SharedPtrVector::iterator imageLocation, Image::Stack& sourceStackLocation, Image::Stack& targetStack)
+	void CombinedImageStack::UnindexStack(const Image::Stack& stack)
 	{
-		targetStack.AddImage(*imageLocation);
-		sourceStackLocation.RemoveImage(imageLocation);
+		StorageSize stackSize = stack.Size();
+		compressedStacksSize -= stackSize;
+		stacksBySize.Erase(stackSize, stack.Id());
 	}
 }
@@ -6,14 +6,57 @@
 #pragma once
 
 #include "Image.h"
+#include "OrderStatisticIndex.h"
+#include "ImageStackSnapshot.h"
+
+#include <array>
+#include <unordered_map>
 
 namespace StorageEstimator
 {
+	struct TypeStatistics
+	{
+		size_t numberOfImages = 0;
+		StorageSize totalSize = 0;		// image sizes before stack compression
+	};
+
+	struct StackSummary
+	{
+		Image::Id id = 0;
+		size_t numberOfImages = 0;
+		StorageSize size = 0;
+
+		std::string ToString() const;
+	};
+
 	class CombinedImageStack : public Image::Stack
 	{
 	private:
+		struct ImageLocation
+		{
+			Image::Id stackId = 0;		// 0 for images outside stacks
+			size_t index = 0;			// slot in the owning stack, removedImageIndex once removed
+		};
+
+		static constexpr size_t removedImageIndex = ~(size_t)0;
+		static constexpr size_t removedStackIndex = ~(size_t)0;
+		static constexpr size_t minimumRemovedStacksToCompact = 64;
+
 		Image::Id idCounter = 0;
-		Image::StackVector imageStacks;
+		Image::Id stackIdCounter = 0;
+		Image::StackVector imageStacks;		// removed stacks are left empty until the vector is compacted
+		size_t numberOfImages = 0;
+		size_t numberOfStacks = 0;
+
+		// Indexed by id - 1, so any image or stack is found in O(1)
+		std::vector<ImageLocation> locationsById;
+		std::vector<size_t> stackIndicesById;
+
+		// Maintained by every change so that queries never scan all images
+		StorageSize compressedStacksSize = 0;
+		std::array<TypeStatistics, (size_t)Image::Type::UNKNOWN> statisticsByType;
+		OrderStatisticIndex<Image::SharedPtr> imagesBySize;
+		OrderStatisticIndex<size_t> stacksBySize;		// payload is the number of images
 
 	public:
 		CombinedImageStack() = default;
@@ -21,16 +64,41 @@ namespace StorageEstimator
 		{}
 	
 		void AddImage(Image::Type imageType, Image::Dimension width, Image::Dimension height);
-		void AddStack(std::vector<Image::Id>& imageIds);
+		Image::Id AddImages(const Image::DescriptionVector& descriptions);
+		void AddStack(const std::vector<Image::Id>& imageIds);
+		void AddStacks(const std::vector<std::vector<Image::Id>>& stacksOfImageIds);
+		bool RemoveImageById(Image::Id imageId);
+		bool UngroupStack(Image::Id stackId);
+		bool ContainsImage(Image::Id imageId) const;
+		bool ContainsStack(Image::Id stackId) const;
+		Image::Id HighestImageId() const;
+		Image::Id HighestStackId() const;
+		void RecomputeSizes();
 		size_t NumberOfImages() const override;
 		size_t NumberOfStacks() const;
+		Image::DescriptionVector ImageDescriptions() const;
+		std::vector<size_t> StackImageCounts() const;
 		StorageSize Size() const override;
 		std::string ToString() const override;
+		std::string SummaryToString() const;
+
+		// Must be called from the thread changing the stack, the snapshot can then be used
+		// from any thread while this stack keeps changing
+		ImageStackSnapshot TakeSnapshot() const;
+
+		const TypeStatistics& StatisticsForType(Image::Type imageType) const;
+		Image::SharedPtrVector LargestImages(size_t count) const;
+		std::vector<StackSummary> LargestStacks(size_t count) const;
+		bool FindImageAtPercentile(double percentile, Image::SharedPtr& image) const;
+		bool FindStackAtPercentile(double percentile, StackSummary& stack) const;
 
 	private:
-		bool FindImageOutsideStacks(Image::Id id, Image::SharedPtrVector::iterator& imageLocation);
-		bool FindImageInStack(Image::Id id, Image::StackVector::iterator& parentStack, Image::SharedPtrVector::iterator& imageLocation);
-		void MoveImageToStack(Image::SharedPtrVector::iterator location, Image::Stack& stack);
-		void MoveImageBetweenStacks(Image::SharedPtrVector::iterator imageLocation, Image::Stack& sourceStackLocation, Image::Stack& targetStack);
+		Image::SharedPtr TakeImage(Image::Id imageId, std::vector<size_t>& changedStackIndices);
+		void FinishChangedStacks(const std::vector<size_t>& changedStackIndices);
+		void CompactIfNeeded();
+		void IndexImage(const Image::SharedPtr& image);
+		void UnindexImage(const Image::SharedPtr& image);
+		void IndexStack(const Image::Stack& stack);
+		void UnindexStack(const Image::Stack& stack);
 	};
 }
@@ -0,0 +1,355 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "CommandStream.h"
+
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	using namespace StorageEstimator;
+
+	const size_t readBlockSize = 1 << 20;
+	const size_t imagesPerBatch = 4096;
+	const unsigned long long maximumDimension = std::numeric_limits<int>::max();
+	const unsigned long long maximumId = std::numeric_limits<Image::Id>::max();
+
+	enum class LineCommand { NoInput, EndProcess, AddImage, AddImageStack, AddImageStacks, Other };
+
+	inline bool IsSpace(char character)
+	{
+		return character == ' ' || character == '\t' || character == '\r' || character == '\n';
+	}
+
+	inline bool IsDigit(char character)
+	{
+		return character >= '0' && character <= '9';
+	}
+
+	const char* SkipSpaces(const char* position, const char* end)
+	{
+		while (position != end && IsSpace(*position)) ++position;
+		return position;
+	}
+
+	// Parses the digits at position, false if there are none or the value exceeds maximum
+	bool ParseNumber(const char*& position, const char* end, unsigned long long maximum, unsigned long long& value)
+	{
+		const char* start = position;
+		value = 0;
+		while (position != end && IsDigit(*position))
+		{
+			value = value * 10 + (*position - '0');
+			if (value > maximum) return false;
+			++position;
+		}
+		return position != start;
+	}
+
+	LineCommand InterpretCommand(const char* begin, const char* end, Image::Type& imageType)
+	{
+		// Same commands as the console, in any letter case
+		char command[9] = {};
+		size_t length = end - begin;
+		if (length == 0) return LineCommand::NoInput;
+		if (length >= sizeof(command)) return LineCommand::Other;
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			command[i] = (char)toupper((unsigned char)begin[i]);
+		}
+
+		if (strcmp(command, "J") == 0 || strcmp(command, "JPG") == 0 || strcmp(command, "JPEG") == 0)
+		{
+			imageType = Image::Type::JPEG;
+			return LineCommand::AddImage;
+		}
+		if (strcmp(command, "JP2") == 0 || strcmp(command, "JPEG2000") == 0)
+		{
+			imageType = Image::Type::JPEG2000;
+			return LineCommand::AddImage;
+		}
+		if (strcmp(command, "BMP") == 0)
+		{
+			imageType = Image::Type::BMP;
+			return LineCommand::AddImage;
+		}
+		if (strcmp(command, "G") == 0)			return LineCommand::AddImageStack;
+		if (strcmp(command, "GROUPS") == 0)		return LineCommand::AddImageStacks;
+		if (strcmp(command, "Q") == 0)			return LineCommand::EndProcess;
+
+		return LineCommand::Other;
+	}
+
+	class LineParser
+	{
+	private:
+		CommandStreamHandler& handler;
+		CommandStreamStatistics& statistics;
+		Image::DescriptionVector pendingImages;
+		std::vector<ImageIdRanges> stacksOfImageIds;
+		size_t numberOfImages = 0;		// including pending images, so also the highest valid id
+
+	public:
+		LineParser(CommandStreamHandler& streamHandler, CommandStreamStatistics& streamStatistics)
+			: handler{ streamHandler }, statistics{ streamStatistics }
+		{
+			pendingImages.reserve(imagesPerBatch);
+		}
+
+		// Returns false at the end of input
+		bool ParseLine(const char* begin, const char* end)
+		{
+			statistics.lines++;
+
+			const char* commandBegin = SkipSpaces(begin, end);
+			const char* commandEnd = commandBegin;
+			while (commandEnd != end && !IsSpace(*commandEnd)) ++commandEnd;
+
+			Image::Type imageType = Image::Type::UNKNOWN;
+			bool isAccepted = true;
+
+			switch (InterpretCommand(commandBegin, commandEnd, imageType))
+			{
+			case LineCommand::NoInput:
+				break;
+
+			case LineCommand::EndProcess:
+				return false;
+
+			case LineCommand::AddImage:
+				isAccepted = ParseImage(imageType, commandEnd, end);
+				break;
+
+			case LineCommand::AddImageStack:
+				isAccepted = ParseStacks(commandEnd, end, false);
+				break;
+
+			case LineCommand::AddImageStacks:
+				isAccepted = ParseStacks(commandEnd, end, true);
+				break;
+
+			case LineCommand::Other:
+			default:
+				statistics.skippedLines++;
+				break;
+			}
+
+			if (!isAccepted) statistics.rejectedLines++;
+			return true;
+		}
+
+		void Flush()
+		{
+			if (pendingImages.empty()) return;
+
+			handler.AddImages(pendingImages);
+			pendingImages.clear();
+		}
+
+	private:
+		bool ParseImage(Image::Type imageType, const char* position, const char* end)
+		{
+			Image::Description description;
+			description.type = imageType;
+
+			unsigned long long width = 0;
+			unsigned long long height = 0;
+
+			position = SkipSpaces(position, end);
+			if (!ParseNumber(position, end, maximumDimension, width) || position == end || !IsSpace(*position)) return false;
+			position = SkipSpaces(position, end);
+			if (!ParseNumber(position, end, maximumDimension, height)) return false;
+			if (SkipSpaces(position, end) != end || numberOfImages == maximumId) return false;
+
+			description.width = (Image::Dimension)width;
+			description.height = (Image::Dimension)height;
+			pendingImages.push_back(description);
+			numberOfImages++;
+			statistics.imagesAdded++;
+
+			if (pendingImages.size() == imagesPerBatch) Flush();
+			return true;
+		}
+
+		bool ParseStacks(const char* position, const char* end, bool allowSeveralStacks)
+		{
+			// Like the console, one invalid group rejects the whole line
+			stacksOfImageIds.clear();
+
+			position = SkipSpaces(position, end);
+			while (end != position && IsSpace(*(end - 1))) --end;
+
+			while (position != end)
+			{
+				const char* stackEnd = allowSeveralStacks ? std::find(position, end, ';') : end;
+				if (stackEnd != position)
+				{
+					stacksOfImageIds.emplace_back();
+					if (!ParseStack(position, stackEnd, stacksOfImageIds.back())) return false;
+				}
+				position = (stackEnd == end) ? end : stackEnd + 1;
+			}
+
+			if (stacksOfImageIds.empty()) return false;
+
+			Flush();
+			handler.AddStacks(stacksOfImageIds);
+			statistics.stacksAdded += stacksOfImageIds.size();
+			return true;
+		}
+
+		bool ParseStack(const char* position, const char* end, ImageIdRanges& ranges)
+		{
+			auto isDelimiter = [](char character) { return character == ',' || IsSpace(character); };
+			unsigned long long numberOfIds = 0;
+
+			while (true)
+			{
+				while (position != end && isDelimiter(*position)) ++position;
+				if (position == end) break;
+
+				unsigned long long firstId = 0;
+				unsigned long long lastId = 0;
+				if (!ParseNumber(position, end, maximumId, firstId)) return false;
+
+				if (position != end && *position == '-')
+				{
+					++position;
+					if (!ParseNumber(position, end, maximumId, lastId)) return false;
+				}
+				else
+				{
+					lastId = firstId;
+				}
+
+				if (position != end && !isDelimiter(*position)) return false;
+				if (firstId < 1 || firstId > lastId || lastId > numberOfImages) return false;
+
+				ranges.emplace_back((Image::Id)firstId, (Image::Id)lastId);
+				numberOfIds += lastId - firstId + 1;
+			}
+
+			// Counted before duplicates are merged, as the console does
+			if (numberOfIds <= 1) return false;
+
+			std::sort(ranges.begin(), ranges.end());
+			size_t mergedRanges = 0;
+			for (size_t i = 1; i < ranges.size(); ++i)
+			{
+				auto& merged = ranges[mergedRanges];
+				if ((unsigned long long)ranges[i].first <= (unsigned long long)merged.second + 1)
+				{
+					merged.second = std::max(merged.second, ranges[i].second);
+				}
+				else
+				{
+					ranges[++mergedRanges] = ranges[i];
+				}
+			}
+			ranges.resize(mergedRanges + 1);
+
+			return true;
+		}
+	};
+}
+
+namespace StorageEstimator
+{
+	double CommandStreamStatistics::LinesPerSecond() const
+	{
+		return (seconds > 0.0) ? lines / seconds : 0.0;
+	}
+
+	std::string CommandStreamStatistics::ToString() const
+	{
+		return "\tRead " + std::to_string(lines) + " lines in " + std::to_string(seconds) + " s (" + std::to_string((size_t)LinesPerSecond()) + " lines/s)\n"
+			+ "\tAdded " + std::to_string(imagesAdded) + " images and " + std::to_string(stacksAdded) + " stacks, rejected " + std::to_string(rejectedLines)
+			+ " lines, skipped " + std::to_string(skippedLines) + " lines with other commands\n";
+	}
+
+	CommandStreamStatistics ReadCommandStream(const std::string& filePath, CommandStreamHandler& handler)
+	{
+		std::ifstream file(filePath, std::ios::binary);
+		if (!file)
+		{
+			throw std::invalid_argument("Could not open '" + filePath + "'");
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		CommandStreamStatistics statistics;
+		LineParser parser(handler, statistics);
+
+		// Lines are parsed in place, only the unfinished last line of a block is moved
+		std::vector<char> buffer(readBlockSize);
+		size_t carriedBytes = 0;
+		bool isReading = true;
+
+		while (isReading)
+		{
+			size_t requestedBytes = buffer.size() - carriedBytes;
+			file.read(buffer.data() + carriedBytes, requestedBytes);
+			size_t readBytes = (size_t)file.gcount();
+			bool isEndOfFile = (readBytes < requestedBytes);
+
+			const char* position = buffer.data();
+			const char* end = buffer.data() + carriedBytes + readBytes;
+
+			while (isReading)
+			{
+				const char* lineEnd = (const char*)memchr(position, '\n', end - position);
+				if (!lineEnd) break;
+
+				isReading = parser.ParseLine(position, lineEnd);
+				position = lineEnd + 1;
+			}
+
+			carriedBytes = end - position;
+
+			if (isReading && isEndOfFile)
+			{
+				if (carriedBytes > 0) parser.ParseLine(position, end);
+				isReading = false;
+			}
+			else if (isReading)
+			{
+				memmove(buffer.data(), position, carriedBytes);
+				if (carriedBytes == buffer.size()) buffer.resize(buffer.size() * 2);		// a line longer than the buffer
+			}
+		}
+
+		parser.Flush();
+		statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		return statistics;
+	}
+
+	void ExactStreamHandler::AddImages(const Image::DescriptionVector& descriptions)
+	{
+		target.AddImages(descriptions);
+	}
+
+	void ExactStreamHandler::AddStacks(const std::vector<ImageIdRanges>& stacksOfImageIds)
+	{
+		std::vector<std::vector<Image::Id>> stacks(stacksOfImageIds.size());
+		for (size_t stackIndex = 0; stackIndex < stacksOfImageIds.size(); ++stackIndex)
+		{
+			for (const auto& range : stacksOfImageIds[stackIndex])
+			{
+				for (unsigned long long id = range.first; id <= range.second; ++id)
+				{
+					stacks[stackIndex].push_back((Image::Id)id);
+				}
+			}
+		}
+
+		target.AddStacks(stacks);
+	}
+}
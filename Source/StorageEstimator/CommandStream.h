@@ -0,0 +1,62 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "CombinedImageStack.h"
+
+#include <utility>
+
+namespace StorageEstimator
+{
+	// Sorted, non-overlapping and inclusive ranges of image ids
+	typedef std::vector<std::pair<Image::Id, Image::Id>> ImageIdRanges;
+
+	class CommandStreamHandler
+	{
+	public:
+		CommandStreamHandler() = default;
+		virtual ~CommandStreamHandler() = default;
+
+		// Images get consecutive ids in the order they are passed, starting at 1
+		virtual void AddImages(const Image::DescriptionVector& descriptions) = 0;
+		virtual void AddStacks(const std::vector<ImageIdRanges>& stacksOfImageIds) = 0;
+	};
+
+	struct CommandStreamStatistics
+	{
+		size_t lines = 0;
+		size_t imagesAdded = 0;
+		size_t stacksAdded = 0;
+		size_t rejectedLines = 0;		// image and group lines the console would refuse
+		size_t skippedLines = 0;		// other commands, which do not take part in streaming
+		double seconds = 0.0;
+
+		double LinesPerSecond() const;
+		std::string ToString() const;
+	};
+
+	// Reads image and group lines, "type width height", "G i, i-j" and "GROUPS i-j; ...", with
+	// the same rules as the console, until the end of the file or a "Q" line. Images are passed
+	// on in batches and every group line flushes the images before it.
+	// Throws std::invalid_argument if the file can not be opened.
+	CommandStreamStatistics ReadCommandStream(const std::string& filePath, CommandStreamHandler& handler);
+
+	// Replays the stream into a CombinedImageStack, for exact results on smaller inputs
+	class ExactStreamHandler : public CommandStreamHandler
+	{
+	private:
+		CombinedImageStack& target;
+
+	public:
+		ExactStreamHandler(CombinedImageStack& targetStack)
+			: target{ targetStack }
+		{}
+		~ExactStreamHandler() = default;
+
+		void AddImages(const Image::DescriptionVector& descriptions) override;
+		void AddStacks(const std::vector<ImageIdRanges>& stacksOfImageIds) override;
+	};
+}
@@ -0,0 +1,159 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <iterator>
+
+namespace StorageEstimator
+{
+	// Vector stored as fixed size chunks which are shared between copies. Copying only copies
+	// the chunk table, and a chunk is cloned the first time it is changed while shared. This
+	// makes copies cheap, consistent snapshots which stay valid while the original keeps
+	// changing, and old chunks are freed once the last copy using them is gone.
+	//
+	// A copy may be read from any thread, but the vector being copied must not be changed at
+	// the same time.
+	template<typename T, size_t ChunkSize = 512>
+	class CopyOnWriteVector
+	{
+	private:
+		typedef std::vector<T> Chunk;
+		std::vector<std::shared_ptr<Chunk>> chunks;
+		size_t count = 0;
+
+	public:
+		class const_iterator
+		{
+		private:
+			const CopyOnWriteVector* vector = nullptr;
+			size_t index = 0;
+
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef T value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const T* pointer;
+			typedef const T& reference;
+
+			const_iterator() = default;
+			const_iterator(const CopyOnWriteVector* iteratedVector, size_t startIndex)
+				: vector{ iteratedVector }, index{ startIndex }
+			{}
+
+			const T& operator*() const { return (*vector)[index]; }
+			const T* operator->() const { return &(*vector)[index]; }
+			const_iterator& operator++() { ++index; return *this; }
+			const_iterator operator++(int) { const_iterator previous(*this); ++index; return previous; }
+			bool operator==(const const_iterator& other) const { return index == other.index; }
+			bool operator!=(const const_iterator& other) const { return index != other.index; }
+		};
+
+		CopyOnWriteVector() = default;
+		~CopyOnWriteVector() = default;
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return count == 0;
+		}
+
+		const T& operator[](size_t index) const
+		{
+			return (*chunks[index / ChunkSize])[index % ChunkSize];
+		}
+
+		const_iterator begin() const
+		{
+			return const_iterator(this, 0);
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator(this, count);
+		}
+
+		T& MutableAt(size_t index)
+		{
+			return MutableChunk(index / ChunkSize)[index % ChunkSize];
+		}
+
+		size_t capacity() const
+		{
+			return chunks.capacity() * ChunkSize;
+		}
+
+		void reserve(size_t capacity)
+		{
+			chunks.reserve((capacity + ChunkSize - 1) / ChunkSize);
+		}
+
+		void push_back(const T& value)
+		{
+			if (count % ChunkSize == 0)
+			{
+				chunks.push_back(std::make_shared<Chunk>());
+				chunks.back()->reserve(ChunkSize);
+			}
+
+			MutableChunk(chunks.size() - 1).push_back(value);
+			++count;
+		}
+
+		void pop_back()
+		{
+			MutableChunk(chunks.size() - 1).pop_back();
+			if (--count % ChunkSize == 0)
+			{
+				chunks.pop_back();
+			}
+		}
+
+		void erase(size_t index)
+		{
+			// Like std::vector::erase this shifts every later element, and chunks after the
+			// erased element are cloned if they are shared
+			for (size_t i = index; i + 1 < count; ++i)
+			{
+				MutableAt(i) = std::move(MutableAt(i + 1));
+			}
+
+			pop_back();
+		}
+
+		void clear()
+		{
+			chunks.clear();
+			count = 0;
+		}
+
+	private:
+		Chunk& MutableChunk(size_t chunkIndex)
+		{
+			std::shared_ptr<Chunk>& chunk = chunks[chunkIndex];
+			if (chunk.use_count() != 1)
+			{
+				std::shared_ptr<Chunk> clonedChunk = std::make_shared<Chunk>();
+				clonedChunk->reserve(ChunkSize);
+				clonedChunk->assign(chunk->begin(), chunk->end());
+				chunk = clonedChunk;
+			}
+			else
+			{
+				// Order this write after the reads of the copy that just released the chunk
+				std::atomic_thread_fence(std::memory_order_acquire);
+			}
+
+			return *chunk;
+		}
+	};
+}
@@ -0,0 +1,893 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "CostModel.h"
+#include "ImageVariants.h"
+
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <functional>
+
+namespace
+{
+	// Every operation takes two arguments so that one dispatch serves both unary and binary ones
+	struct AddOperation { double operator()(double left, double right) const { return left + right; } };
+	struct SubtractOperation { double operator()(double left, double right) const { return left - right; } };
+	struct MultiplyOperation { double operator()(double left, double right) const { return left * right; } };
+	struct DivideOperation { double operator()(double left, double right) const { return left / right; } };
+	struct PowOperation { double operator()(double left, double right) const { return std::pow(left, right); } };
+	struct MinOperation { double operator()(double left, double right) const { return std::min(left, right); } };
+	struct MaxOperation { double operator()(double left, double right) const { return std::max(left, right); } };
+	struct NegateOperation { double operator()(double value, double) const { return -value; } };
+	struct LogOperation { double operator()(double value, double) const { return std::log(value); } };
+	struct Log2Operation { double operator()(double value, double) const { return std::log2(value); } };
+	struct Log10Operation { double operator()(double value, double) const { return std::log10(value); } };
+	struct ExpOperation { double operator()(double value, double) const { return std::exp(value); } };
+	struct SqrtOperation { double operator()(double value, double) const { return std::sqrt(value); } };
+	struct FloorOperation { double operator()(double value, double) const { return std::floor(value); } };
+	struct CeilOperation { double operator()(double value, double) const { return std::ceil(value); } };
+
+	struct ArrayOperand
+	{
+		const double* values;
+		double operator[](size_t i) const { return values[i]; }
+	};
+
+	struct ScalarOperand
+	{
+		double value;
+		double operator[](size_t) const { return value; }
+	};
+
+	double ClampSize(double size)
+	{
+		// Negative, NaN and too large results from custom models are clamped to the sizes a
+		// plain cast can convert without overflowing
+		const double largestSize = 9223372036854774784.0;		// largest double below 2^63
+		size = (size > 0.0) ? size : 0.0;
+		return (size < largestSize) ? size : largestSize;
+	}
+
+	double ToDouble(StorageEstimator::Image::Dimension dimension)
+	{
+		// Same value as a plain conversion, but through the signed conversion SSE2 can vectorize
+		return (double)(int)(dimension ^ 0x80000000u) + 2147483648.0;
+	}
+
+	StorageSize ToStorageSize(double size)
+	{
+		// Matches a plain cast for every value the built-in formulas produce
+		return (StorageSize)(long long)ClampSize(size);
+	}
+
+	std::string Trim(const std::string& str)
+	{
+		size_t first = str.find_first_not_of(" \t\r\n");
+		if (first == std::string::npos) return "";
+		size_t last = str.find_last_not_of(" \t\r\n");
+		return str.substr(first, last - first + 1);
+	}
+}
+
+namespace StorageEstimator
+{
+	class CostExpressionCompiler
+	{
+	private:
+		typedef CostExpression::OpCode OpCode;
+		typedef CostExpression::Operand Operand;
+		typedef CostExpression::Instruction Instruction;
+
+		const std::string& text;
+		const std::vector<std::string>& variableNames;
+		CostExpression& expression;
+		size_t position = 0;
+		size_t stackDepth = 0;
+
+	public:
+		CostExpressionCompiler(const std::string& expressionText, const std::vector<std::string>& names, CostExpression& compiledExpression)
+			: text{ expressionText }, variableNames{ names }, expression{ compiledExpression }
+		{}
+
+		void Compile()
+		{
+			// Recursive descent which emits postfix code as it parses
+			ParseSum();
+			SkipSpaces();
+			if (position != text.size())
+			{
+				Fail("unexpected '" + text.substr(position, 1) + "'");
+			}
+		}
+
+	private:
+		void ParseSum()
+		{
+			ParseProduct();
+			while (true)
+			{
+				if (Accept('+'))		{ ParseProduct(); EmitOperation(OpCode::Add); }
+				else if (Accept('-'))	{ ParseProduct(); EmitOperation(OpCode::Subtract); }
+				else					break;
+			}
+		}
+
+		void ParseProduct()
+		{
+			ParseUnary();
+			while (true)
+			{
+				if (Accept('*'))		{ ParseUnary(); EmitOperation(OpCode::Multiply); }
+				else if (Accept('/'))	{ ParseUnary(); EmitOperation(OpCode::Divide); }
+				else					break;
+			}
+		}
+
+		void ParseUnary()
+		{
+			if (Accept('-'))
+			{
+				ParseUnary();
+				EmitOperation(OpCode::Negate);
+			}
+			else
+			{
+				ParsePrimary();
+			}
+		}
+
+		void ParsePrimary()
+		{
+			SkipSpaces();
+			if (position >= text.size()) Fail("the expression ends too early");
+
+			char character = text[position];
+			if (std::isdigit((unsigned char)character) || character == '.')
+			{
+				const char* start = text.c_str() + position;
+				char* end = nullptr;
+				double value = std::strtod(start, &end);
+				if (end == start) Fail("invalid number");
+
+				position += end - start;
+				EmitConstant(value);
+			}
+			else if (std::isalpha((unsigned char)character) || character == '_')
+			{
+				size_t nameStart = position;
+				while (position < text.size() && (std::isalnum((unsigned char)text[position]) || text[position] == '_')) position++;
+				std::string name = text.substr(nameStart, position - nameStart);
+
+				if (Accept('('))
+				{
+					ParseFunctionCall(name);
+				}
+				else
+				{
+					auto variable = std::find(variableNames.begin(), variableNames.end(), name);
+					if (variable == variableNames.end()) Fail("unknown variable '" + name + "'");
+					EmitVariable((unsigned int)(variable - variableNames.begin()));
+				}
+			}
+			else if (Accept('('))
+			{
+				ParseSum();
+				Expect(')');
+			}
+			else
+			{
+				Fail("unexpected '" + std::string(1, character) + "'");
+			}
+		}
+
+		void ParseFunctionCall(const std::string& name)
+		{
+			struct Function { const char* name; OpCode opCode; size_t numberOfArguments; };
+			static const Function functions[] = {
+				{ "log", OpCode::Log, 1 }, { "log2", OpCode::Log2, 1 }, { "log10", OpCode::Log10, 1 },
+				{ "exp", OpCode::Exp, 1 }, { "sqrt", OpCode::Sqrt, 1 },
+				{ "floor", OpCode::Floor, 1 }, { "ceil", OpCode::Ceil, 1 },
+				{ "pow", OpCode::Pow, 2 }, { "min", OpCode::Min, 2 }, { "max", OpCode::Max, 2 }
+			};
+
+			auto function = std::find_if(std::begin(functions), std::end(functions), [&name](const Function& f) { return name == f.name; });
+			if (function == std::end(functions)) Fail("unknown function '" + name + "'");
+
+			for (size_t argument = 0; argument < function->numberOfArguments; ++argument)
+			{
+				if (argument > 0) Expect(',');
+				ParseSum();
+			}
+			Expect(')');
+
+			EmitOperation(function->opCode);
+		}
+
+		void EmitConstant(double value)
+		{
+			expression.instructions.push_back({ OpCode::Load, Operand::Constant, Operand::None, (unsigned int)expression.constants.size(), 0 });
+			expression.constants.push_back(value);
+			Push();
+		}
+
+		void EmitVariable(unsigned int variableIndex)
+		{
+			expression.instructions.push_back({ OpCode::Load, Operand::Variable, Operand::None, variableIndex, 0 });
+			Push();
+		}
+
+		void EmitOperation(OpCode opCode)
+		{
+			// Operations on constants are folded with the same arithmetic used at run time, and
+			// constant or variable operands are read directly instead of being loaded first
+			auto& instructions = expression.instructions;
+			auto isLoad = [&instructions](size_t fromBack, Operand operand) {
+				if (instructions.size() <= fromBack) return false;
+				const Instruction& instruction = instructions[instructions.size() - 1 - fromBack];
+				return instruction.opCode == OpCode::Load && (instruction.left == operand || operand == Operand::None);
+			};
+
+			if (CostExpression::IsUnary(opCode))
+			{
+				if (isLoad(0, Operand::Constant))
+				{
+					double& value = expression.constants[instructions.back().leftIndex];
+					value = CostExpression::Apply(opCode, value, 0.0);
+				}
+				else if (isLoad(0, Operand::Variable))
+				{
+					instructions.back().opCode = opCode;
+				}
+				else
+				{
+					instructions.push_back({ opCode, Operand::Stack, Operand::None, 0, 0 });
+				}
+				return;
+			}
+
+			if (isLoad(0, Operand::Constant) && isLoad(1, Operand::Constant))
+			{
+				unsigned int rightIndex = instructions.back().leftIndex;
+				instructions.pop_back();
+				double& left = expression.constants[instructions.back().leftIndex];
+				left = CostExpression::Apply(opCode, left, expression.constants[rightIndex]);
+			}
+			else if (isLoad(0, Operand::None))
+			{
+				Instruction right = instructions.back();
+				instructions.pop_back();
+
+				if (isLoad(0, Operand::None))
+				{
+					Instruction& left = instructions.back();
+					left = { opCode, left.left, right.left, left.leftIndex, right.leftIndex };
+				}
+				else
+				{
+					instructions.push_back({ opCode, Operand::Stack, right.left, 0, right.leftIndex });
+				}
+			}
+			else
+			{
+				instructions.push_back({ opCode, Operand::Stack, Operand::Stack, 0, 0 });
+			}
+			stackDepth--;
+		}
+
+		void Push()
+		{
+			if (++stackDepth > CostExpression::maximumStackDepth) Fail("the expression is nested too deeply");
+		}
+
+		void SkipSpaces()
+		{
+			while (position < text.size() && std::isspace((unsigned char)text[position])) position++;
+		}
+
+		bool Accept(char character)
+		{
+			SkipSpaces();
+			if (position < text.size() && text[position] == character)
+			{
+				position++;
+				return true;
+			}
+			return false;
+		}
+
+		void Expect(char character)
+		{
+			if (!Accept(character)) Fail("expected '" + std::string(1, character) + "'");
+		}
+
+		[[noreturn]] void Fail(const std::string& reason) const
+		{
+			throw std::invalid_argument("Invalid expression '" + text + "': " + reason);
+		}
+	};
+
+	CostExpression::CostExpression(const std::string& expressionText, const std::vector<std::string>& variableNames)
+		: text{ expressionText }
+	{
+		CostExpressionCompiler(text, variableNames, *this).Compile();
+	}
+
+	const std::string& CostExpression::Text() const
+	{
+		return text;
+	}
+
+	bool CostExpression::UsesVariable(unsigned int variableIndex) const
+	{
+		return std::any_of(instructions.begin(), instructions.end(), [variableIndex](const Instruction& instruction) {
+			return (instruction.left == Operand::Variable && instruction.leftIndex == variableIndex)
+				|| (instruction.right == Operand::Variable && instruction.rightIndex == variableIndex);
+		});
+	}
+
+	bool CostExpression::IsUnary(OpCode opCode)
+	{
+		switch (opCode)
+		{
+		case OpCode::Negate:
+		case OpCode::Log:
+		case OpCode::Log2:
+		case OpCode::Log10:
+		case OpCode::Exp:
+		case OpCode::Sqrt:
+		case OpCode::Floor:
+		case OpCode::Ceil:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	template<typename Function>
+	void CostExpression::WithOperation(OpCode opCode, Function function)
+	{
+		switch (opCode)
+		{
+		case OpCode::Add:		function(AddOperation()); break;
+		case OpCode::Subtract:	function(SubtractOperation()); break;
+		case OpCode::Multiply:	function(MultiplyOperation()); break;
+		case OpCode::Divide:	function(DivideOperation()); break;
+		case OpCode::Pow:		function(PowOperation()); break;
+		case OpCode::Min:		function(MinOperation()); break;
+		case OpCode::Max:		function(MaxOperation()); break;
+		case OpCode::Negate:	function(NegateOperation()); break;
+		case OpCode::Log:		function(LogOperation()); break;
+		case OpCode::Log2:		function(Log2Operation()); break;
+		case OpCode::Log10:		function(Log10Operation()); break;
+		case OpCode::Exp:		function(ExpOperation()); break;
+		case OpCode::Sqrt:		function(SqrtOperation()); break;
+		case OpCode::Floor:		function(FloorOperation()); break;
+		case OpCode::Ceil:		function(CeilOperation()); break;
+		default:
+			throw std::logic_error("CostExpression has no operation for a load instruction");
+		}
+	}
+
+	double CostExpression::Apply(OpCode opCode, double left, double right)
+	{
+		double result = 0.0;
+		WithOperation(opCode, [&](auto operation) { result = operation(left, right); });
+		return result;
+	}
+
+	void CostExpression::Evaluate(const double* const* variables, double* results, size_t count) const
+	{
+		double stack[maximumStackDepth][blockSize];
+
+		for (size_t blockStart = 0; blockStart < count; blockStart += blockSize)
+		{
+			size_t blockCount = std::min(blockSize, count - blockStart);
+			size_t top = 0;
+
+			for (size_t instructionIndex = 0; instructionIndex < instructions.size(); ++instructionIndex)
+			{
+				// The last instruction writes straight to the results
+				const Instruction& instruction = instructions[instructionIndex];
+				bool isLast = (instructionIndex + 1 == instructions.size());
+
+				if (instruction.opCode == OpCode::Load)
+				{
+					double* target = isLast ? results + blockStart : stack[top];
+					if (instruction.left == Operand::Constant)
+					{
+						std::fill(target, target + blockCount, constants[instruction.leftIndex]);
+					}
+					else
+					{
+						const double* values = variables[instruction.leftIndex] + blockStart;
+						std::copy(values, values + blockCount, target);
+					}
+					top++;
+					continue;
+				}
+
+				size_t stackOperands = (instruction.left == Operand::Stack) + (instruction.right == Operand::Stack);
+				const double* leftStack = stack[top - stackOperands];
+				const double* rightStack = stack[top - 1];
+				double* target = isLast ? results + blockStart : stack[top - stackOperands];
+				top = top - stackOperands + 1;
+
+				auto run = [&](auto left, auto right) {
+					WithOperation(instruction.opCode, [&](auto operation) {
+						for (size_t i = 0; i < blockCount; ++i) target[i] = operation(left[i], right[i]);
+					});
+				};
+				auto withRight = [&](auto left) {
+					switch (instruction.right)
+					{
+					case Operand::Stack:	run(left, ArrayOperand{ rightStack }); break;
+					case Operand::Constant:	run(left, ScalarOperand{ constants[instruction.rightIndex] }); break;
+					case Operand::Variable:	run(left, ArrayOperand{ variables[instruction.rightIndex] + blockStart }); break;
+					case Operand::None:		run(left, ScalarOperand{ 0.0 }); break;
+					}
+				};
+
+				switch (instruction.left)
+				{
+				case Operand::Constant:	withRight(ScalarOperand{ constants[instruction.leftIndex] }); break;
+				case Operand::Variable:	withRight(ArrayOperand{ variables[instruction.leftIndex] + blockStart }); break;
+				default:				withRight(ArrayOperand{ leftStack }); break;
+				}
+			}
+		}
+	}
+
+	double CostExpression::Evaluate(const double* variables) const
+	{
+		double stack[maximumStackDepth];
+		size_t top = 0;
+
+		for (const Instruction& instruction : instructions)
+		{
+			auto value = [&](Operand operand, unsigned int index, size_t stackPosition) {
+				switch (operand)
+				{
+				case Operand::Stack:	return stack[stackPosition];
+				case Operand::Constant:	return constants[index];
+				case Operand::Variable:	return variables[index];
+				default:				return 0.0;
+				}
+			};
+
+			size_t stackOperands = (instruction.left == Operand::Stack) + (instruction.right == Operand::Stack);
+			double left = value(instruction.left, instruction.leftIndex, top - stackOperands);
+			double right = value(instruction.right, instruction.rightIndex, top - 1);
+			top -= stackOperands;
+			stack[top++] = (instruction.opCode == OpCode::Load) ? left : Apply(instruction.opCode, left, right);
+		}
+
+		return (top > 0) ? stack[top - 1] : 0.0;
+	}
+}
+
+namespace
+{
+	using namespace StorageEstimator;
+
+	const std::vector<std::string> imageVariableNames = { "width", "height", "level" };
+	const std::vector<std::string> stackVariableNames = { "uncompressed", "count" };
+
+	// Only accessed through std::atomic_load and std::atomic_store
+	std::shared_ptr<const CostModel> activeModel;
+}
+
+namespace StorageEstimator
+{
+	const std::string CostModel::defaultDefinition =
+		"JPEG pyramid = width * height * 0.2\n"
+		"JPEG2000 image = width * height * 0.4 / log(log(width * height + 16))\n"
+		"BMP pyramid = width * height\n"
+		"STACK = uncompressed / log(count + 3)\n";
+
+	CostModel::CostModel()
+		: name{ "built-in" }
+	{
+		ApplyDefinition(defaultDefinition);
+	}
+
+	CostModel CostModel::FromString(const std::string& definition, const std::string& modelName)
+	{
+		CostModel model;
+		model.ApplyDefinition(definition);
+		model.name = modelName;
+		return model;
+	}
+
+	CostModel CostModel::FromFile(const std::string& filePath)
+	{
+		std::ifstream file(filePath);
+		if (!file)
+		{
+			throw std::invalid_argument("'" + filePath + "' could not be opened");
+		}
+
+		std::stringstream definition;
+		definition << file.rdbuf();
+		return FromString(definition.str(), filePath);
+	}
+
+	void CostModel::ApplyDefinition(const std::string& definition)
+	{
+		std::istringstream lines(definition);
+		std::string line;
+		size_t lineNumber = 0;
+
+		while (std::getline(lines, line))
+		{
+			lineNumber++;
+			line = Trim(line.substr(0, line.find('#')));
+			if (line.empty()) continue;
+
+			std::string linePrefix = "Line " + std::to_string(lineNumber) + ": ";
+			size_t separator = line.find('=');
+			if (separator == std::string::npos)
+			{
+				throw std::invalid_argument(linePrefix + "expected 'TYPE pyramid|image = expression' or 'STACK = expression'");
+			}
+
+			std::istringstream targetTokens(line.substr(0, separator));
+			std::string target, ruleName, extraToken;
+			targetTokens >> target >> ruleName >> extraToken;
+			std::transform(target.begin(), target.end(), target.begin(), ::toupper);
+			std::transform(ruleName.begin(), ruleName.end(), ruleName.begin(), ::tolower);
+			std::string expressionText = Trim(line.substr(separator + 1));
+
+			try
+			{
+				if (target == "STACK" && ruleName.empty())
+				{
+					stackExpression = CostExpression(expressionText, stackVariableNames);
+					continue;
+				}
+
+				Image::Type type = Image::TypeToEnum(target);
+				if (type == Image::Type::UNKNOWN)
+				{
+					throw std::invalid_argument("unknown target '" + target + "'");
+				}
+				if ((ruleName != "pyramid" && ruleName != "image") || !extraToken.empty())
+				{
+					throw std::invalid_argument("the rule for " + target + " must be 'pyramid' or 'image'");
+				}
+
+				ImageRule& imageRule = imageRules[(size_t)type];
+				imageRule.rule = (ruleName == "pyramid") ? SizeRule::Pyramid : SizeRule::Image;
+				imageRule.expression = CostExpression(expressionText, imageVariableNames);
+			}
+			catch (const std::invalid_argument& error)
+			{
+				throw std::invalid_argument(linePrefix + error.what());
+			}
+		}
+	}
+
+	const CostModel::ImageRule& CostModel::RuleForType(Image::Type type) const
+	{
+		if (type == Image::Type::UNKNOWN)
+		{
+			throw std::invalid_argument("Unknown image type supplied to CostModel");
+		}
+
+		return imageRules[(size_t)type];
+	}
+
+	StorageSize CostModel::ImageSize(Image::Type type, Image::Dimension width, Image::Dimension height) const
+	{
+		const ImageRule& imageRule = RuleForType(type);
+		unsigned int level = 0;
+		auto levelSize = [&imageRule, &level](Image::Dimension levelWidth, Image::Dimension levelHeight) {
+			const double variables[] = { (double)levelWidth, (double)levelHeight, (double)level++ };
+			return ToStorageSize(imageRule.expression.Evaluate(variables));
+		};
+
+		if (imageRule.rule == SizeRule::Pyramid) return Image::AbstractPyramid::PyramidSize(width, height, levelSize);
+		return levelSize(width, height);
+	}
+
+	void CostModel::ImageSizes(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const
+	{
+		const ImageRule& imageRule = RuleForType(type);
+		if (imageRule.rule == SizeRule::Pyramid)
+		{
+			PyramidSizes(imageRule.expression, widths, heights, sizes, count);
+			return;
+		}
+
+		double widthValues[CostExpression::blockSize];
+		double heightValues[CostExpression::blockSize];
+		double levelValues[CostExpression::blockSize] = {};
+		double results[CostExpression::blockSize];
+		const double* variables[] = { widthValues, heightValues, levelValues };
+
+		for (size_t blockStart = 0; blockStart < count; blockStart += CostExpression::blockSize)
+		{
+			size_t blockCount = std::min(CostExpression::blockSize, count - blockStart);
+			for (size_t i = 0; i < blockCount; ++i)
+			{
+				widthValues[i] = widths[blockStart + i];
+				heightValues[i] = heights[blockStart + i];
+			}
+
+			imageRule.expression.Evaluate(variables, results, blockCount);
+
+			for (size_t i = 0; i < blockCount; ++i)
+			{
+				sizes[blockStart + i] = ToStorageSize(results[i]);
+			}
+		}
+	}
+
+	void CostModel::PyramidSizes(const CostExpression& expression, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const
+	{
+		// A block is evaluated level by level for all of its images at once, and an image only
+		// adds the levels it has. Every loop runs over the whole block, so compilers vectorize
+		// them and no branch depends on the dimensions. Blocks where most of those evaluations
+		// would be wasted on images without the level are evaluated image by image instead.
+		const size_t blockSize = CostExpression::blockSize;
+		Image::Dimension blockWidths[blockSize];
+		Image::Dimension blockHeights[blockSize];
+		unsigned int levelCounts[blockSize];
+		StorageSize blockSizes[blockSize];
+		double widthValues[blockSize];
+		double heightValues[blockSize];
+		double levelValues[blockSize];
+		double results[blockSize];
+		const double* variables[] = { widthValues, heightValues, levelValues };
+		bool usesLevel = expression.UsesVariable(2);
+
+		for (size_t blockStart = 0; blockStart < count; blockStart += blockSize)
+		{
+			size_t blockCount = std::min(blockSize, count - blockStart);
+			unsigned int mostLevels = 0;
+			size_t totalLevels = 0;
+			for (size_t i = 0; i < blockCount; ++i)
+			{
+				blockWidths[i] = widths[blockStart + i];
+				blockHeights[i] = heights[blockStart + i];
+				levelCounts[i] = PyramidLevelCount(blockWidths[i], blockHeights[i]);
+				mostLevels = std::max(mostLevels, levelCounts[i]);
+				totalLevels += levelCounts[i];
+			}
+
+			if (mostLevels * blockSize > 2 * totalLevels)
+			{
+				PyramidSizesByImage(expression, widths + blockStart, heights + blockStart, sizes + blockStart, blockCount);
+				continue;
+			}
+
+			// Unused entries of the last block have no levels
+			std::fill(blockWidths + blockCount, blockWidths + blockSize, 0);
+			std::fill(blockHeights + blockCount, blockHeights + blockSize, 0);
+			std::fill(levelCounts + blockCount, levelCounts + blockSize, 0);
+			std::fill(blockSizes, blockSizes + blockSize, 0);
+
+			for (unsigned int level = 0; level < mostLevels; ++level)
+			{
+				for (size_t i = 0; i < blockSize; ++i)
+				{
+					widthValues[i] = ToDouble(blockWidths[i] >> level);
+					heightValues[i] = ToDouble(blockHeights[i] >> level);
+				}
+				if (usesLevel) std::fill(levelValues, levelValues + blockSize, (double)level);
+
+				expression.Evaluate(variables, results, blockSize);
+
+				for (size_t i = 0; i < blockSize; ++i)
+				{
+					results[i] = ClampSize(results[i]);
+				}
+				for (size_t i = 0; i < blockSize; ++i)
+				{
+					blockSizes[i] += (StorageSize)(long long)results[i] * (StorageSize)(level < levelCounts[i]);
+				}
+			}
+
+			std::copy(blockSizes, blockSizes + blockCount, sizes + blockStart);
+		}
+	}
+
+	void CostModel::PyramidSizesByImage(const CostExpression& expression, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const
+	{
+		// The levels of consecutive images are laid out one after another and evaluated as one
+		// block, with the same halving as AbstractPyramid::PyramidSize. The size of an image is
+		// then the difference of two running sums. An image never spans two blocks, so a block is
+		// evaluated as soon as the levels of the next image might not fit.
+		const size_t blockSize = CostExpression::blockSize;
+		const size_t maximumLevels = 32;
+		double widthValues[blockSize];
+		double heightValues[blockSize];
+		double levelValues[blockSize];
+		double results[blockSize];
+		StorageSize runningSizes[blockSize + 1] = {};
+		size_t levelEnds[blockSize];
+		const double* variables[] = { widthValues, heightValues, levelValues };
+		bool usesLevel = expression.UsesVariable(2);
+
+		for (size_t imageIndex = 0; imageIndex < count; )
+		{
+			size_t firstImageIndex = imageIndex;
+			size_t numberOfLevels = 0;
+
+			for (; imageIndex < count && numberOfLevels + maximumLevels <= blockSize; ++imageIndex)
+			{
+				Image::Dimension width = widths[imageIndex];
+				Image::Dimension height = heights[imageIndex];
+				size_t firstLevel = numberOfLevels;
+				do
+				{
+					widthValues[numberOfLevels] = width;
+					heightValues[numberOfLevels] = height;
+					numberOfLevels++;
+					width /= 2;
+					height /= 2;
+				} while (width >= Image::AbstractPyramid::minimumPyramidDimension && height >= Image::AbstractPyramid::minimumPyramidDimension);
+
+				levelEnds[imageIndex - firstImageIndex] = numberOfLevels;
+				if (usesLevel)
+				{
+					for (size_t level = firstLevel; level < numberOfLevels; ++level) levelValues[level] = (double)(level - firstLevel);
+				}
+			}
+
+			expression.Evaluate(variables, results, numberOfLevels);
+
+			// Clamping in a pass of its own keeps the compiler from branching around the
+			// conversion. Unsigned sums may wrap, their differences are still exact.
+			for (size_t i = 0; i < numberOfLevels; ++i)
+			{
+				results[i] = ClampSize(results[i]);
+			}
+			for (size_t i = 0; i < numberOfLevels; ++i)
+			{
+				runningSizes[i + 1] = runningSizes[i] + (StorageSize)(long long)results[i];
+			}
+
+			size_t levelStart = 0;
+			for (size_t i = firstImageIndex; i < imageIndex; ++i)
+			{
+				size_t levelEnd = levelEnds[i - firstImageIndex];
+				sizes[i] = runningSizes[levelEnd] - runningSizes[levelStart];
+				levelStart = levelEnd;
+			}
+		}
+	}
+
+	unsigned int CostModel::PyramidLevelCount(Image::Dimension width, Image::Dimension height)
+	{
+		// Level n exists while the smaller dimension shifted by n stays at or above the minimum
+		// of 2^7, so the count follows from the exponent of the smaller dimension as a double,
+		// which holds every dimension exactly
+		static_assert(Image::AbstractPyramid::minimumPyramidDimension == 128, "the level count assumes a minimum of 2^7");
+		double smallerDimension = std::min(width, height);
+		unsigned long long bits;
+		std::memcpy(&bits, &smallerDimension, sizeof(bits));
+		int highestBit = (int)(bits >> 52) - 1023;
+
+		return (highestBit > 7) ? (unsigned int)(highestBit - 6) : 1;
+	}
+
+	StorageSize CostModel::StackSize(StorageSize uncompressedSize, size_t numberOfImages) const
+	{
+		const double variables[] = { (double)uncompressedSize, (double)numberOfImages };
+		return ToStorageSize(stackExpression.Evaluate(variables));
+	}
+
+	const std::string& CostModel::Name() const
+	{
+		return name;
+	}
+
+	std::string CostModel::ToString() const
+	{
+		std::string output = "\tCost model: " + name + "\n";
+
+		for (size_t type = 0; type < imageRules.size(); ++type)
+		{
+			const ImageRule& imageRule = imageRules[type];
+			output += "\t" + Image::TypeToString((Image::Type)type) + ((imageRule.rule == SizeRule::Pyramid) ? " pyramid" : " image") + " = " + imageRule.expression.Text() + "\n";
+		}
+		output += "\tSTACK = " + stackExpression.Text() + "\n";
+
+		return output;
+	}
+
+	std::shared_ptr<const CostModel> CostModel::Active()
+	{
+		return std::atomic_load(&activeModel);
+	}
+
+	void CostModel::Activate(const CostModel& model)
+	{
+		std::atomic_store(&activeModel, std::make_shared<const CostModel>(model));
+	}
+
+	void CostModel::ActivateBuiltIn()
+	{
+		std::atomic_store(&activeModel, std::shared_ptr<const CostModel>());
+	}
+
+	std::string CostModelComparison::ToString() const
+	{
+		double ratio = (builtInSeconds > 0.0) ? modelSeconds / builtInSeconds : 0.0;
+		return "\tCompared " + std::to_string(numberOfSizes) + " sizes, " + std::to_string(numberOfDifferentSizes) + " differ from the built-in formulas\n"
+			+ "\tImage sizes took " + std::to_string(builtInSeconds) + " s built-in and " + std::to_string(modelSeconds) + " s with the model (" + std::to_string(ratio) + "x)\n";
+	}
+
+	CostModelComparison CompareWithBuiltInFormulas(const CostModel& model, size_t sizesPerType)
+	{
+		// Dimensions stay below 65536 so that width * height fits the 32 bit products the
+		// built-in formulas use, and the pyramid level boundaries are always included
+		std::mt19937 random(2018);
+		std::uniform_int_distribution<Image::Dimension> drawDimension(0, 65535);
+		const Image::Dimension boundaries[] = { 0, 1, 127, 128, 129, 255, 256, 257, 511, 512, 4095, 4096, 65535 };
+
+		std::vector<Image::Dimension> widths;
+		std::vector<Image::Dimension> heights;
+		for (auto width : boundaries)
+		{
+			for (auto height : boundaries)
+			{
+				widths.push_back(width);
+				heights.push_back(height);
+			}
+		}
+		while (widths.size() < sizesPerType)
+		{
+			widths.push_back(drawDimension(random));
+			heights.push_back(drawDimension(random));
+		}
+
+		CostModelComparison comparison;
+		std::vector<StorageSize> builtInSizes(widths.size());
+		std::vector<StorageSize> modelSizes(widths.size());
+
+		const Image::Type types[] = { Image::Type::JPEG, Image::Type::JPEG2000, Image::Type::BMP };
+		for (auto type : types)
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			Image::EstimateSizesWithBuiltInFormulas(type, widths.data(), heights.data(), builtInSizes.data(), widths.size());
+			auto builtInTime = std::chrono::steady_clock::now();
+			model.ImageSizes(type, widths.data(), heights.data(), modelSizes.data(), widths.size());
+			auto modelTime = std::chrono::steady_clock::now();
+
+			comparison.builtInSeconds += std::chrono::duration<double>(builtInTime - startTime).count();
+			comparison.modelSeconds += std::chrono::duration<double>(modelTime - builtInTime).count();
+			comparison.numberOfSizes += widths.size();
+			comparison.numberOfDifferentSizes += widths.size() - std::inner_product(builtInSizes.begin(), builtInSizes.end(), modelSizes.begin(), (size_t)0, std::plus<size_t>(), std::equal_to<StorageSize>());
+		}
+
+		std::uniform_int_distribution<StorageSize> drawUncompressedSize(0, 1ull << 40);
+		std::uniform_int_distribution<size_t> drawNumberOfImages(0, 100000);
+		for (size_t i = 0; i < sizesPerType; ++i)
+		{
+			StorageSize uncompressedSize = drawUncompressedSize(random);
+			size_t numberOfImages = drawNumberOfImages(random);
+
+			comparison.numberOfSizes++;
+			if (model.StackSize(uncompressedSize, numberOfImages) != Image::Stack::CompressedSizeWithBuiltInFormula(uncompressedSize, numberOfImages))
+			{
+				comparison.numberOfDifferentSizes++;
+			}
+		}
+
+		return comparison;
+	}
+}
@@ -0,0 +1,136 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "Image.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace StorageEstimator
+{
+	// Arithmetic expression compiled to postfix bytecode. Evaluate runs one instruction at a
+	// time over a whole block of inputs, so the interpreter overhead is paid per block rather
+	// than per value and the inner loops are plain array arithmetic.
+	class CostExpression
+	{
+	public:
+		static constexpr size_t blockSize = 256;
+		static constexpr size_t maximumStackDepth = 16;
+
+	private:
+		enum class OpCode : unsigned char { Load, Add, Subtract, Multiply, Divide, Negate, Log, Log2, Log10, Exp, Sqrt, Floor, Ceil, Pow, Min, Max };
+		enum class Operand : unsigned char { None, Stack, Constant, Variable };
+
+		struct Instruction
+		{
+			// Operands are popped from the stack or, to save a pass over the block, read directly
+			// from a constant or variable. Every instruction pushes its result.
+			OpCode opCode;
+			Operand left;
+			Operand right;
+			unsigned int leftIndex;		// into constants or variables
+			unsigned int rightIndex;
+		};
+
+		std::string text;
+		std::vector<Instruction> instructions;
+		std::vector<double> constants;
+
+	public:
+		CostExpression() = default;
+		// Throws std::invalid_argument if text is not a valid expression of variableNames
+		CostExpression(const std::string& expressionText, const std::vector<std::string>& variableNames);
+		~CostExpression() = default;
+
+		const std::string& Text() const;
+		bool UsesVariable(unsigned int variableIndex) const;
+
+		// variables[v] holds count values of variable v, in the order of variableNames
+		void Evaluate(const double* const* variables, double* results, size_t count) const;
+		// Single value of every variable, for one-off sizes where a block would be wasted
+		double Evaluate(const double* variables) const;
+
+	private:
+		friend class CostExpressionCompiler;
+		static bool IsUnary(OpCode opCode);
+		static double Apply(OpCode opCode, double left, double right);
+
+		template<typename Function>
+		static void WithOperation(OpCode opCode, Function function);
+	};
+
+	// Size formulas for every image type and for stack compression. A model is defined by
+	// lines of the form
+	//
+	//		JPEG pyramid = width * height * 0.2
+	//		JPEG2000 image = width * height * 0.4 / log(log(width * height + 16))
+	//		STACK = uncompressed / log(count + 3)
+	//
+	// A pyramid expression gives the size of one level, with level 0 at full resolution. Image
+	// expressions may use width, height and level, the stack expression uncompressed and count.
+	class CostModel
+	{
+	public:
+		enum class SizeRule { Image, Pyramid };
+
+		static const std::string defaultDefinition;		// the built-in formulas
+
+	private:
+		struct ImageRule
+		{
+			SizeRule rule = SizeRule::Image;
+			CostExpression expression;
+		};
+
+		std::array<ImageRule, (size_t)Image::Type::UNKNOWN> imageRules;
+		CostExpression stackExpression;
+		std::string name;
+
+	public:
+		CostModel();
+		~CostModel() = default;
+
+		// Lines missing from the definition keep the default formula. Both throw
+		// std::invalid_argument with the offending line.
+		static CostModel FromString(const std::string& definition, const std::string& modelName);
+		static CostModel FromFile(const std::string& filePath);
+
+		StorageSize ImageSize(Image::Type type, Image::Dimension width, Image::Dimension height) const;
+		void ImageSizes(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const;
+		StorageSize StackSize(StorageSize uncompressedSize, size_t numberOfImages) const;
+		const std::string& Name() const;
+		std::string ToString() const;
+
+		// The model used by every size computation, empty while the built-in formulas are used.
+		// A replaced model is freed once no thread holds it any longer.
+		static std::shared_ptr<const CostModel> Active();
+		static void Activate(const CostModel& model);
+		static void ActivateBuiltIn();
+
+	private:
+		void ApplyDefinition(const std::string& definition);
+		const ImageRule& RuleForType(Image::Type type) const;
+		static unsigned int PyramidLevelCount(Image::Dimension width, Image::Dimension height);
+		void PyramidSizes(const CostExpression& expression, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const;
+		void PyramidSizesByImage(const CostExpression& expression, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count) const;
+	};
+
+	struct CostModelComparison
+	{
+		size_t numberOfSizes = 0;
+		size_t numberOfDifferentSizes = 0;
+		double builtInSeconds = 0.0;
+		double modelSeconds = 0.0;
+
+		std::string ToString() const;
+	};
+
+	// Computes the same random image and stack sizes with the model and with the built-in formulas
+	CostModelComparison CompareWithBuiltInFormulas(const CostModel& model, size_t sizesPerType);
+}
@@ -0,0 +1,251 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "DirectoryScanner.h"
+#include "ImageHeaders.h"
+
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	using namespace StorageEstimator;
+
+	struct FileBatch
+	{
+		size_t directoryIndex = 0;
+		std::vector<std::string> filePaths;
+	};
+
+	struct DescriptionBatch
+	{
+		size_t directoryIndex = 0;
+		size_t filesRead = 0;
+		Image::DescriptionVector descriptions;
+	};
+
+	template<typename T>
+	class BoundedQueue
+	{
+	private:
+		std::mutex mutex;
+		std::condition_variable notFull;
+		std::condition_variable notEmpty;
+		std::deque<T> items;
+		size_t capacity;
+		bool closed = false;
+
+	public:
+		BoundedQueue(size_t maximumItems)
+			: capacity{ maximumItems }
+		{}
+
+		void Push(T item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			notFull.wait(lock, [this] { return items.size() < capacity; });
+			items.push_back(std::move(item));
+			notEmpty.notify_one();
+		}
+
+		bool Pop(T& item)
+		{
+			// Returns false once the queue is closed and drained
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+			if (items.empty()) return false;
+
+			item = std::move(items.front());
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+		}
+	};
+
+	void WalkDirectories(const std::filesystem::path& rootDirectory, size_t filesPerBatch, BoundedQueue<FileBatch>& fileQueue)
+	{
+		// Depth first walk where all files of a directory are emitted before moving on, so
+		// that each batch belongs to exactly one directory. Symlinked directories are not
+		// followed to avoid cycles, and unreadable entries are skipped.
+		std::vector<std::filesystem::path> pendingDirectories = { rootDirectory };
+		size_t directoryIndex = 0;
+
+		while (!pendingDirectories.empty())
+		{
+			std::filesystem::path directory = std::move(pendingDirectories.back());
+			pendingDirectories.pop_back();
+
+			size_t currentDirectoryIndex = directoryIndex++;
+
+			FileBatch batch;
+			batch.directoryIndex = currentDirectoryIndex;
+
+			std::error_code error;
+			std::filesystem::directory_iterator entry(directory, error);
+			for (; !error && entry != std::filesystem::directory_iterator(); entry.increment(error))
+			{
+				std::error_code statusError;
+				if (entry->is_symlink(statusError))
+				{
+					if (!entry->is_regular_file(statusError)) continue;
+				}
+				else if (entry->is_directory(statusError))
+				{
+					pendingDirectories.push_back(entry->path());
+					continue;
+				}
+				else if (!entry->is_regular_file(statusError))
+				{
+					continue;
+				}
+
+				batch.filePaths.push_back(entry->path().string());
+				if (batch.filePaths.size() >= filesPerBatch)
+				{
+					fileQueue.Push(std::move(batch));
+					batch = FileBatch();
+					batch.directoryIndex = currentDirectoryIndex;
+				}
+			}
+
+			if (!batch.filePaths.empty())
+			{
+				fileQueue.Push(std::move(batch));
+			}
+		}
+
+		fileQueue.Close();
+	}
+
+	void ReadHeaders(BoundedQueue<FileBatch>& fileQueue, BoundedQueue<DescriptionBatch>& descriptionQueue)
+	{
+		FileBatch files;
+		while (fileQueue.Pop(files))
+		{
+			DescriptionBatch batch;
+			batch.directoryIndex = files.directoryIndex;
+			batch.filesRead = files.filePaths.size();
+			batch.descriptions.reserve(files.filePaths.size());
+
+			Image::Description description;
+			for (const auto& filePath : files.filePaths)
+			{
+				if (Image::ReadDescriptionFromHeader(filePath, description))
+				{
+					batch.descriptions.push_back(description);
+				}
+			}
+
+			descriptionQueue.Push(std::move(batch));
+		}
+	}
+}
+
+namespace StorageEstimator
+{
+	double ScanResult::FilesPerSecond() const
+	{
+		return (seconds > 0.0) ? filesVisited / seconds : 0.0;
+	}
+
+	std::string ScanResult::ToString() const
+	{
+		return "\tScanned " + std::to_string(filesVisited) + " files in " + std::to_string(seconds) + " s (" + std::to_string((size_t)FilesPerSecond()) + " files/s)\n"
+			+ "\tAdded " + std::to_string(imagesAdded) + " images and " + std::to_string(stacksAdded) + " stacks, skipped " + std::to_string(filesVisited - imagesAdded) + " files\n";
+	}
+
+	ScanResult DirectoryScanner::Scan(const std::string& rootDirectory, CombinedImageStack& target) const
+	{
+		std::error_code error;
+		if (!std::filesystem::is_directory(rootDirectory, error))
+		{
+			throw std::invalid_argument("'" + rootDirectory + "' is not a directory");
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		// Pipeline: one directory walker -> header readers -> this thread, which is the only
+		// one touching the target. Both queues are bounded so memory stays constant no matter
+		// how many files the tree contains.
+		BoundedQueue<FileBatch> fileQueue(settings.maximumQueuedBatches);
+		BoundedQueue<DescriptionBatch> descriptionQueue(settings.maximumQueuedBatches);
+
+		unsigned int numberOfReaders = settings.numberOfThreads;
+		if (numberOfReaders == 0) numberOfReaders = std::max(1u, std::thread::hardware_concurrency());
+
+		std::thread walker(WalkDirectories, std::filesystem::path(rootDirectory), std::max<size_t>(1, settings.filesPerBatch), std::ref(fileQueue));
+
+		std::atomic<unsigned int> activeReaders(numberOfReaders);
+		std::vector<std::thread> readers;
+		for (unsigned int i = 0; i < numberOfReaders; ++i)
+		{
+			readers.emplace_back([&]
+			{
+				ReadHeaders(fileQueue, descriptionQueue);
+				if (--activeReaders == 0) descriptionQueue.Close();
+			});
+		}
+
+		ScanResult result;
+		std::vector<std::vector<Image::Id>> imageIdsByDirectory;
+
+		DescriptionBatch batch;
+		while (descriptionQueue.Pop(batch))
+		{
+			Image::Id firstId = target.AddImages(batch.descriptions);
+			result.filesVisited += batch.filesRead;
+			result.imagesAdded += batch.descriptions.size();
+
+			if (settings.groupImagesBySubdirectory)
+			{
+				if (imageIdsByDirectory.size() <= batch.directoryIndex)
+				{
+					imageIdsByDirectory.resize(batch.directoryIndex + 1);
+				}
+
+				auto& directoryImageIds = imageIdsByDirectory[batch.directoryIndex];
+				for (Image::Id id = firstId; id < firstId + batch.descriptions.size(); ++id)
+				{
+					directoryImageIds.push_back(id);
+				}
+			}
+		}
+
+		walker.join();
+		for (auto& reader : readers)
+		{
+			reader.join();
+		}
+
+		std::vector<std::vector<Image::Id>> stacksOfImageIds;
+		for (auto& directoryImageIds : imageIdsByDirectory)
+		{
+			if (directoryImageIds.size() > 1)
+			{
+				stacksOfImageIds.push_back(std::move(directoryImageIds));
+			}
+		}
+
+		target.AddStacks(stacksOfImageIds);
+		result.stacksAdded = stacksOfImageIds.size();
+
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		return result;
+	}
+}
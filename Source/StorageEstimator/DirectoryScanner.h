@@ -0,0 +1,46 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "CombinedImageStack.h"
+
+namespace StorageEstimator
+{
+	struct ScanSettings
+	{
+		bool groupImagesBySubdirectory = false;
+		unsigned int numberOfThreads = 0;		// 0 uses one header reader per hardware thread
+		size_t filesPerBatch = 1024;
+		size_t maximumQueuedBatches = 64;		// per queue, bounds the memory of files in flight
+	};
+
+	struct ScanResult
+	{
+		size_t filesVisited = 0;
+		size_t imagesAdded = 0;
+		size_t stacksAdded = 0;
+		double seconds = 0.0;
+
+		double FilesPerSecond() const;
+		std::string ToString() const;
+	};
+
+	class DirectoryScanner
+	{
+	private:
+		ScanSettings settings;
+
+	public:
+		DirectoryScanner(const ScanSettings& scanSettings)
+			: settings{ scanSettings }
+		{}
+		~DirectoryScanner() = default;
+
+		// Walks the directory tree and adds every JPEG, JPEG2000 and BMP file to the target.
+		// Throws std::invalid_argument if rootDirectory is not a directory.
+		ScanResult Scan(const std::string& rootDirectory, CombinedImageStack& target) const;
+	};
+}
@@ -4,6 +4,8 @@
 */
 
 #include "Image.h"
+#include "ImageVariants.h"
+#include "CostModel.h"
 
 /*
 	Typedefs and procedures
@@ -27,20 +29,20 @@ namespace StorageEstimator
 			return Image::Type::UNKNOWN;
 		}
 
-		bool FindByIdInVector(Image::SharedPtrVector& images, Image::Id id, Image::SharedPtrVector::iterator& imageLocation)
+		bool FindByIdInVector(const Image::SharedPtrVector& images, Image::Id id, size_t& imageIndex)
 		{
-			imageLocation = images.end();
+			imageIndex = images.size();
 
-			for (int index = 0; index < images.size(); ++index)
+			for (size_t index = 0; index < images.size(); ++index)
 			{
-				if (images[index]->Id() == id)
+				if (images[index] && images[index]->Id() == id)
 				{
-					imageLocation = (images.begin() + index);
+					imageIndex = index;
 					break;
 				}
 			}
 
-			return (imageLocation != images.end());
+			return (imageIndex != images.size());
 		}
 	}
 }
@@ -53,11 +55,29 @@ namespace StorageEstimator
 {
 	namespace Image
 	{
+		AbstractBase::AbstractBase(Image::Id imageId, Image::Type imageType, Image::Dimension imageWidth, Image::Dimension imageHeight)
+			: id{ imageId }, type{ imageType }, width{ imageWidth }, height{ imageHeight }, size{ Image::EstimateSize(imageType, imageWidth, imageHeight) }
+		{}
+
 		Image::Id AbstractBase::Id() const 
 		{ 
 			return id; 
 		}
 
+		StorageSize AbstractBase::Size() const
+		{
+			return size;
+		}
+
+		Image::Description AbstractBase::Describe() const
+		{
+			Image::Description description;
+			description.type = type;
+			description.width = width;
+			description.height = height;
+			return description;
+		}
+
 		std::string AbstractBase::ToString() const
 		{
 			std::string typeStr = Image::TypeToString(type);
@@ -71,78 +91,134 @@ namespace StorageEstimator
 {
 	namespace Image
 	{
-		StorageSize AbstractPyramid::Size() const
+		Image::Id Stack::Id() const
 		{
-			const int minimumPyramidDimension = 128;
-
-			Image::Dimension pyramidWidth = width;
-			Image::Dimension pyramidHeight = height;
-			StorageSize totalSize = 0;
-			do
-			{
-				totalSize += PyramidLevelSize(pyramidWidth, pyramidHeight);
-				pyramidWidth /= 2;
-				pyramidHeight /= 2;
-			} while (pyramidWidth >= minimumPyramidDimension && pyramidHeight >= minimumPyramidDimension);
-
-			return totalSize;
+			return id;
 		}
-	}
-}
 
-namespace StorageEstimator
-{
-	namespace Image
-	{
 		bool Stack::IsEmpty() const 
 		{ 
-			return images.size() == 0; 
+			return NumberOfOccupiedSlots() == 0; 
 		}
 
-		void Stack::AddImage(Image::SharedPtr newImage) 
+		size_t Stack::AddImage(Image::SharedPtr newImage) 
 		{ 
 			images.push_back(newImage); 
+			uncompressedSize += newImage->Size();
+			UpdateCompressedSize();
+			return images.size() - 1;
 		}
 
-		void Stack::RemoveImage(Image::SharedPtrVector::iterator imageLocation)
+		void Stack::RemoveImage(size_t imageIndex)
 		{
-			images.erase(imageLocation);
+			// Leaves a tombstone so that the indices of all other images stay valid
+			uncompressedSize -= images[imageIndex]->Size();
+			images.MutableAt(imageIndex) = nullptr;
+			numberOfRemovedImages++;
+			UpdateCompressedSize();
 		}
 
-		bool Stack::FindImage(Image::Id id, Image::SharedPtrVector::iterator& imageLocation)
+		bool Stack::FindImage(Image::Id id, size_t& imageIndex) const
 		{
-			return Image::FindByIdInVector(images, id, imageLocation);
+			return Image::FindByIdInVector(images, id, imageIndex);
 		}
 
-		size_t Stack::NumberOfImages() const
+		const Image::SharedPtr& Stack::ImageAt(size_t imageIndex) const
+		{
+			return images[imageIndex];
+		}
+
+		size_t Stack::NumberOfImageSlots() const
 		{
 			return images.size();
 		}
 
+		size_t Stack::NumberOfImages() const
+		{
+			return NumberOfOccupiedSlots();
+		}
+
+		size_t Stack::NumberOfOccupiedSlots() const
+		{
+			// Not virtual, derived stacks count images held elsewhere in NumberOfImages
+			return images.size() - numberOfRemovedImages;
+		}
+
 		StorageSize Stack::Size() const
 		{
-			StorageSize totalSize = 0;
-			for (const auto& image : images)
+			return compressedSize;
+		}
+
+		void Stack::UpdateCompressedSize()
+		{
+			compressedSize = CompressedSize(uncompressedSize, NumberOfOccupiedSlots());
+		}
+
+		StorageSize Stack::CompressedSize(StorageSize uncompressedSize, size_t numberOfImages)
+		{
+			if (auto model = CostModel::Active()) return model->StackSize(uncompressedSize, numberOfImages);
+
+			return CompressedSizeWithBuiltInFormula(uncompressedSize, numberOfImages);
+		}
+
+		StorageSize Stack::CompressedSizeWithBuiltInFormula(StorageSize uncompressedSize, size_t numberOfImages)
+		{
+			// Apply compression to stack according to requirements
+			return (StorageSize)(uncompressedSize / log(numberOfImages + 3));
+		}
+
+		void Stack::AppendImageDescriptions(Image::DescriptionVector& descriptions) const
+		{
+			ForEachImage([&descriptions](const Image::SharedPtr& image) {
+				descriptions.push_back(image->Describe());
+			});
+		}
+
+		void Stack::RecomputeSize()
+		{
+			// Replaces every image by a copy sized with the active CostModel, copies of the stack
+			// taken before keep the old images and sizes
+			uncompressedSize = 0;
+			for (size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex)
 			{
-				totalSize += image->Size();
+				if (!images[imageIndex]) continue;
+
+				Image::Description description = images[imageIndex]->Describe();
+				Image::SharedPtr image = Image::MakeSharedPtrByType(description.type, images[imageIndex]->Id(), description.type, description.width, description.height);
+				uncompressedSize += image->Size();
+				images.MutableAt(imageIndex) = image;
 			}
+			UpdateCompressedSize();
+		}
 
-			// Apply compression to stack according to requirements
-			totalSize = (StorageSize)(totalSize / log(images.size() + 3));
+		bool Stack::NeedsCompaction() const
+		{
+			// Compacting once removed images outnumber the remaining ones keeps the cost amortized O(1) per removal
+			return numberOfRemovedImages >= minimumRemovedImagesToCompact && numberOfRemovedImages > NumberOfOccupiedSlots();
+		}
 
-			return totalSize;
+		void Stack::Compact()
+		{
+			// Drops tombstones while keeping the order, so image indices change
+			Image::SharedPtrVector remainingImages;
+			remainingImages.reserve(NumberOfOccupiedSlots());
+			ForEachImage([&remainingImages](const Image::SharedPtr& image) {
+				remainingImages.push_back(image);
+			});
+
+			images = remainingImages;
+			numberOfRemovedImages = 0;
 		}
 
 		std::string Stack::ToString() const
 		{
 			std::string output;
 
-			for (const auto& image : images)
-			{
+			ForEachImage([&output](const Image::SharedPtr& image) {
 				output += "\t  " + image->ToString() + "\n";
-			}
+			});
 
-			output += "\t\t" + std::to_string(images.size()) + " images, compressed to " + StorageEstimator::StorageSizeToString(Size()) + " bytes\n";
+			output += "\t\t" + std::to_string(NumberOfImages()) + " images, compressed to " + StorageEstimator::StorageSizeToString(Size()) + " bytes\n";
 
 			return output;
 		}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "BaseInterface.h"
+#include "CopyOnWriteVector.h"
 
 #include <vector>
 #include <string>
@@ -21,13 +22,22 @@ namespace StorageEstimator
 		typedef unsigned int Id;
 		typedef unsigned int Dimension;
 		typedef std::shared_ptr<class AbstractBase> SharedPtr;
-		typedef std::vector<Image::SharedPtr> SharedPtrVector;
-		typedef std::vector<class Stack> StackVector;
+		typedef CopyOnWriteVector<Image::SharedPtr> SharedPtrVector;
+		typedef CopyOnWriteVector<class Stack> StackVector;
 
 		enum class Type { JPEG, JPEG2000, BMP, UNKNOWN };
+
+		struct Description
+		{
+			Image::Type type = Image::Type::UNKNOWN;
+			Image::Dimension width = 0;
+			Image::Dimension height = 0;
+		};
+		typedef std::vector<Image::Description> DescriptionVector;
+
 		std::string TypeToString(Image::Type type);
 		Image::Type TypeToEnum(std::string type);
-		bool FindByIdInVector(Image::SharedPtrVector& images, Image::Id id, Image::SharedPtrVector::iterator& imageLocation);
+		bool FindByIdInVector(const Image::SharedPtrVector& images, Image::Id id, size_t& imageIndex);	// skips removed images
 	}
 }
 
@@ -45,46 +55,91 @@ namespace StorageEstimator
 			Image::Id id = 0;
 			Image::Dimension width = 0;
 			Image::Dimension height = 0;
+			StorageSize size = 0;		// with the CostModel active at construction, images never change
 
 		public:
-			AbstractBase(Image::Id imageId, Image::Type imageType, Image::Dimension imageWidth, Image::Dimension imageHeight)
-				: id{ imageId }, type{ imageType }, width{ imageWidth }, height{ imageHeight }
-			{}
+			AbstractBase(Image::Id imageId, Image::Type imageType, Image::Dimension imageWidth, Image::Dimension imageHeight);
 			~AbstractBase() = default;
 
 			Image::Id Id() const;
-			virtual StorageSize Size() const = 0;
+			Image::Description Describe() const;
+			virtual StorageSize Size() const override final;
 			virtual std::string ToString() const;
 		};
 
 		class AbstractPyramid : public Image::AbstractBase
 		{
 		public:
+			static const Image::Dimension minimumPyramidDimension = 128;
+
 			AbstractPyramid(Image::Id imageId, Image::Type imageType, Image::Dimension imageWidth, Image::Dimension imageHeight)
 				: Image::AbstractBase(imageId, imageType, imageWidth, imageHeight)
 			{}
 			~AbstractPyramid() = default;
 
-			virtual StorageSize Size() const override final;
-			virtual StorageSize PyramidLevelSize(Image::Dimension width, Image::Dimension height) const = 0;
+			template<typename LevelSizeFunction>
+			static StorageSize PyramidSize(Image::Dimension width, Image::Dimension height, LevelSizeFunction levelSize)
+			{
+				StorageSize totalSize = 0;
+				do
+				{
+					totalSize += levelSize(width, height);
+					width /= 2;
+					height /= 2;
+				} while (width >= minimumPyramidDimension && height >= minimumPyramidDimension);
+
+				return totalSize;
+			}
 		};
 		
 		class Stack : public StorageEstimator::BaseInterface
 		{
 		protected:
-			Image::SharedPtrVector images;
+			Image::Id id = 0;
+			Image::SharedPtrVector images;		// removed images leave nullptr until the stack is compacted
+			size_t numberOfRemovedImages = 0;
+			StorageSize uncompressedSize = 0;
+			StorageSize compressedSize = 0;		// kept with the sizes of the images, so copies never mix models
 
 		public:
+			static constexpr size_t minimumRemovedImagesToCompact = 64;
+
 			Stack() = default;
+			Stack(Image::Id stackId)
+				: id{ stackId }
+			{}
 			~Stack() = default;
 
+			Image::Id Id() const;
 			bool IsEmpty() const;
-			void AddImage(Image::SharedPtr newImage);
-			void RemoveImage(Image::SharedPtrVector::iterator imageLocation);
-			bool FindImage(Image::Id id, Image::SharedPtrVector::iterator& imageLocation);
+			size_t AddImage(Image::SharedPtr newImage);
+			void RemoveImage(size_t imageIndex);
+			bool FindImage(Image::Id id, size_t& imageIndex) const;
+			const Image::SharedPtr& ImageAt(size_t imageIndex) const;
+			size_t NumberOfImageSlots() const;
 			virtual size_t NumberOfImages() const;
 			virtual StorageSize Size() const override;
 			virtual std::string ToString() const override;
+			void AppendImageDescriptions(Image::DescriptionVector& descriptions) const;
+			void RecomputeSize();
+			bool NeedsCompaction() const;
+			void Compact();
+
+			template<typename Function>
+			void ForEachImage(Function function) const
+			{
+				for (const auto& image : images)
+				{
+					if (image) function(image);
+				}
+			}
+
+			static StorageSize CompressedSize(StorageSize uncompressedSize, size_t numberOfImages);
+			static StorageSize CompressedSizeWithBuiltInFormula(StorageSize uncompressedSize, size_t numberOfImages);
+
+		private:
+			size_t NumberOfOccupiedSlots() const;
+			void UpdateCompressedSize();
 		};
 
 	}
@@ -0,0 +1,218 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "ImageHeaders.h"
+
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+	typedef unsigned char Byte;
+
+	unsigned int ReadBigEndian16(const Byte* bytes)
+	{
+		return (bytes[0] << 8) | bytes[1];
+	}
+
+	unsigned int ReadBigEndian32(const Byte* bytes)
+	{
+		return ((unsigned int)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+	}
+
+	unsigned int ReadLittleEndian16(const Byte* bytes)
+	{
+		return bytes[0] | (bytes[1] << 8);
+	}
+
+	unsigned int ReadLittleEndian32(const Byte* bytes)
+	{
+		return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+	}
+
+	bool ReadBytes(std::ifstream& file, Byte* target, std::streamsize count)
+	{
+		file.read((char*)target, count);
+		return file.gcount() == count;
+	}
+
+	bool SetDescription(StorageEstimator::Image::Type type, unsigned int width, unsigned int height, StorageEstimator::Image::Description& description)
+	{
+		description.type = type;
+		description.width = width;
+		description.height = height;
+
+		return (width > 0 && height > 0);
+	}
+
+	bool IsJPEGStartOfFrame(Byte marker)
+	{
+		// SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC) which share the range
+		return (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC);
+	}
+
+	bool ReadJPEGHeader(std::ifstream& file, StorageEstimator::Image::Description& description)
+	{
+		// The file is positioned right after the SOI marker. Segments are skipped by their
+		// length field until a start of frame segment is found.
+		Byte segment[4];
+		while (ReadBytes(file, segment, 2))
+		{
+			if (segment[0] != 0xFF) return false;
+
+			Byte marker = segment[1];
+			while (marker == 0xFF)
+			{
+				if (!ReadBytes(file, &marker, 1)) return false;
+			}
+
+			bool isStandaloneMarker = (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7));
+			if (isStandaloneMarker) continue;
+
+			bool isEndOfHeader = (marker == 0xD9 || marker == 0xDA);
+			if (isEndOfHeader) return false;
+
+			if (!ReadBytes(file, segment, 2)) return false;
+			unsigned int segmentLength = ReadBigEndian16(segment);
+			if (segmentLength < 2) return false;
+
+			if (IsJPEGStartOfFrame(marker))
+			{
+				Byte frame[5];
+				if (!ReadBytes(file, frame, 5)) return false;
+				return SetDescription(StorageEstimator::Image::Type::JPEG, ReadBigEndian16(frame + 3), ReadBigEndian16(frame + 1), description);
+			}
+
+			file.seekg(segmentLength - 2, std::ios::cur);
+		}
+
+		return false;
+	}
+
+	bool ReadJPEG2000CodestreamHeader(std::ifstream& file, StorageEstimator::Image::Description& description)
+	{
+		// The file is positioned right after the SOC marker, which must be followed by SIZ
+		Byte siz[22];
+		if (!ReadBytes(file, siz, 22)) return false;
+		if (siz[0] != 0xFF || siz[1] != 0x51) return false;
+
+		// The image area is the reference grid minus its offset
+		unsigned int gridWidth = ReadBigEndian32(siz + 6);
+		unsigned int gridHeight = ReadBigEndian32(siz + 10);
+		unsigned int offsetX = ReadBigEndian32(siz + 14);
+		unsigned int offsetY = ReadBigEndian32(siz + 18);
+		if (offsetX > gridWidth || offsetY > gridHeight) return false;
+
+		return SetDescription(StorageEstimator::Image::Type::JPEG2000, gridWidth - offsetX, gridHeight - offsetY, description);
+	}
+
+	bool ReadJP2Header(std::ifstream& file, StorageEstimator::Image::Description& description)
+	{
+		// The file is positioned right after the signature box. Boxes are skipped until the
+		// image header box (ihdr) inside the header superbox (jp2h) is found.
+		Byte box[8];
+		while (ReadBytes(file, box, 8))
+		{
+			unsigned long long boxLength = ReadBigEndian32(box);
+			unsigned int boxType = ReadBigEndian32(box + 4);
+			unsigned long long headerLength = 8;
+
+			if (boxLength == 1)
+			{
+				Byte extendedLength[8];
+				if (!ReadBytes(file, extendedLength, 8)) return false;
+				boxLength = ((unsigned long long)ReadBigEndian32(extendedLength) << 32) | ReadBigEndian32(extendedLength + 4);
+				headerLength = 16;
+			}
+
+			const unsigned int headerSuperBox = 0x6A703268;	// 'jp2h'
+			const unsigned int imageHeaderBox = 0x69686472;	// 'ihdr'
+			const unsigned int codestreamBox = 0x6A703263;	// 'jp2c'
+
+			if (boxType == imageHeaderBox)
+			{
+				Byte header[8];
+				if (!ReadBytes(file, header, 8)) return false;
+				return SetDescription(StorageEstimator::Image::Type::JPEG2000, ReadBigEndian32(header + 4), ReadBigEndian32(header), description);
+			}
+			else if (boxType == codestreamBox)
+			{
+				Byte startOfCodestream[2];
+				if (!ReadBytes(file, startOfCodestream, 2)) return false;
+				if (startOfCodestream[0] != 0xFF || startOfCodestream[1] != 0x4F) return false;
+				return ReadJPEG2000CodestreamHeader(file, description);
+			}
+			else if (boxType != headerSuperBox)
+			{
+				// Length 0 means the box extends to the end of the file
+				if (boxLength == 0 || boxLength < headerLength) return false;
+				file.seekg(boxLength - headerLength, std::ios::cur);
+			}
+		}
+
+		return false;
+	}
+
+	bool ReadBMPHeader(std::ifstream& file, StorageEstimator::Image::Description& description)
+	{
+		// The file is positioned right after the "BM" signature
+		Byte header[24];
+		if (!ReadBytes(file, header, 20)) return false;
+
+		unsigned int infoHeaderSize = ReadLittleEndian32(header + 12);
+		if (infoHeaderSize == 12)
+		{
+			// BITMAPCOREHEADER uses 16 bit dimensions
+			return SetDescription(StorageEstimator::Image::Type::BMP, ReadLittleEndian16(header + 16), ReadLittleEndian16(header + 18), description);
+		}
+
+		if (!ReadBytes(file, header + 20, 4)) return false;
+
+		// Negative heights are used for top-down bitmaps
+		int width = (int)ReadLittleEndian32(header + 16);
+		int height = (int)ReadLittleEndian32(header + 20);
+		if (width < 0) return false;
+		return SetDescription(StorageEstimator::Image::Type::BMP, width, abs(height), description);
+	}
+}
+
+namespace StorageEstimator
+{
+	namespace Image
+	{
+		bool ReadDescriptionFromHeader(const std::string& filePath, Image::Description& description)
+		{
+			std::ifstream file(filePath, std::ios::binary);
+			if (!file) return false;
+
+			Byte signature[12];
+			if (!ReadBytes(file, signature, 2)) return false;
+
+			if (signature[0] == 0xFF && signature[1] == 0xD8)
+			{
+				return ReadJPEGHeader(file, description);
+			}
+			else if (signature[0] == 0xFF && signature[1] == 0x4F)
+			{
+				return ReadJPEG2000CodestreamHeader(file, description);
+			}
+			else if (signature[0] == 'B' && signature[1] == 'M')
+			{
+				return ReadBMPHeader(file, description);
+			}
+			else if (ReadBytes(file, signature + 2, 10))
+			{
+				const Byte jp2Signature[12] = { 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A };
+				if (std::equal(signature, signature + 12, jp2Signature))
+				{
+					return ReadJP2Header(file, description);
+				}
+			}
+
+			return false;
+		}
+	}
+}
@@ -0,0 +1,18 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "Image.h"
+
+namespace StorageEstimator
+{
+	namespace Image
+	{
+		// Reads only as much of the file as needed to identify the image type and dimensions.
+		// Returns false for files which are not JPEG, JPEG2000 (JP2 or raw codestream) or BMP.
+		bool ReadDescriptionFromHeader(const std::string& filePath, Image::Description& description);
+	}
+}
@@ -0,0 +1,68 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "ImageStackSnapshot.h"
+
+namespace StorageEstimator
+{
+	size_t ImageStackSnapshot::NumberOfImages() const
+	{
+		return numberOfImages;
+	}
+
+	size_t ImageStackSnapshot::NumberOfStacks() const
+	{
+		return numberOfStacks;
+	}
+
+	StorageSize ImageStackSnapshot::Size() const
+	{
+		return totalSize;
+	}
+
+	std::string ImageStackSnapshot::ToString() const
+	{
+		std::string outputString;
+
+		if (imagesOutsideStacks.IsEmpty())
+		{
+			outputString += "\tNo images outside stacks\n";
+		}
+		else
+		{
+			imagesOutsideStacks.ForEachImage([&outputString](const Image::SharedPtr& image) {
+				outputString += "\t" + image->ToString() + "\n";
+			});
+		}
+		outputString += "\n";
+
+
+		if (NumberOfStacks() == 0)
+		{
+			outputString += "\tNo image stacks\n";
+		}
+		else
+		{
+			for (const auto& stack : imageStacks)
+			{
+				if (stack.IsEmpty()) continue;
+				outputString += "\tStack " + std::to_string(stack.Id()) + ":\n" + stack.ToString() + "\n";
+			}
+		}
+		outputString += "\n\tTotal Size: " + StorageSizeToString(Size()) + " bytes\n\n";
+
+		return outputString;
+	}
+
+	std::string ImageStackSnapshot::SummaryToString() const
+	{
+		std::string outputString;
+		outputString += "\t" + std::to_string(NumberOfImages()) + " images, " + std::to_string(imagesOutsideStacks.NumberOfImages()) + " outside stacks\n";
+		outputString += "\t" + std::to_string(NumberOfStacks()) + " image stacks\n";
+		outputString += "\n\tTotal Size: " + StorageSizeToString(Size()) + " bytes\n\n";
+
+		return outputString;
+	}
+}
@@ -0,0 +1,59 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "Image.h"
+
+namespace StorageEstimator
+{
+	// Immutable view of a CombinedImageStack. Shares its storage with the stack it was taken
+	// from, so taking one costs a copy of the chunk tables rather than of every image.
+	class ImageStackSnapshot : public StorageEstimator::BaseInterface
+	{
+	private:
+		Image::Stack imagesOutsideStacks;
+		Image::StackVector imageStacks;		// may contain empty slots left by removed stacks
+		size_t numberOfImages = 0;
+		size_t numberOfStacks = 0;
+		StorageSize totalSize = 0;
+
+	public:
+		ImageStackSnapshot() = default;
+		ImageStackSnapshot(const Image::Stack& looseImages, const Image::StackVector& stacks, size_t imageCount, size_t stackCount, StorageSize size)
+			: imagesOutsideStacks{ looseImages }, imageStacks{ stacks }, numberOfImages{ imageCount }, numberOfStacks{ stackCount }, totalSize{ size }
+		{}
+		~ImageStackSnapshot() = default;
+
+		size_t NumberOfImages() const;
+		size_t NumberOfStacks() const;
+		StorageSize Size() const override;
+		std::string ToString() const override;
+		std::string SummaryToString() const;
+	};
+
+	// Hands the latest snapshot from the writing thread to any number of reading threads.
+	// Readers keep the version they loaded alive for as long as they use it, and each
+	// version is freed when its last reader lets go.
+	class SnapshotPublisher
+	{
+	private:
+		std::shared_ptr<const ImageStackSnapshot> latestSnapshot = std::make_shared<const ImageStackSnapshot>();
+
+	public:
+		SnapshotPublisher() = default;
+		~SnapshotPublisher() = default;
+
+		void Publish(const ImageStackSnapshot& snapshot)
+		{
+			std::atomic_store(&latestSnapshot, std::make_shared<const ImageStackSnapshot>(snapshot));
+		}
+
+		std::shared_ptr<const ImageStackSnapshot> Latest() const
+		{
+			return std::atomic_load(&latestSnapshot);
+		}
+	};
+}
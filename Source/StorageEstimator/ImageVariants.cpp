@@ -4,24 +4,83 @@
 */
 
 #include "ImageVariants.h"
+#include "CostModel.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace StorageEstimator
+{
+	namespace Image
+	{
+		StorageSize BMP::LevelSize(Image::Dimension width, Image::Dimension height)
+		{
+			return (StorageSize)width * height;
+		}
+
+		StorageSize JPEG::LevelSize(Image::Dimension width, Image::Dimension height)
+		{
+			return (StorageSize)((StorageSize)width * height * 0.2);
+		}
+
+		StorageSize JPEG2000::ImageSize(Image::Dimension width, Image::Dimension height)
+		{
+			// Widened before multiplying, width * height overflows 32 bits for large images
+			StorageSize numberOfPixels = (StorageSize)width * height;
+			return (StorageSize)(numberOfPixels * 0.4 / log(log(numberOfPixels + 16)));
+		}
+	}
+}
 
 namespace StorageEstimator
 {
 	namespace Image
 	{
-		StorageSize BMP::PyramidLevelSize(Image::Dimension width, Image::Dimension height) const
+		StorageSize EstimateSize(Image::Type type, Image::Dimension width, Image::Dimension height)
 		{
-			return width*height;
+			StorageSize size = 0;
+			EstimateSizes(type, &width, &height, &size, 1);
+			return size;
 		}
 
-		StorageSize JPEG::PyramidLevelSize(Image::Dimension width, Image::Dimension height) const
+		void EstimateSizes(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count)
 		{
-			return (StorageSize)(width * height * 0.2);
+			if (auto model = CostModel::Active())
+			{
+				model->ImageSizes(type, widths, heights, sizes, count);
+			}
+			else
+			{
+				EstimateSizesWithBuiltInFormulas(type, widths, heights, sizes, count);
+			}
 		}
 
-		StorageSize JPEG2000::Size() const
+		void EstimateSizesWithBuiltInFormulas(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count)
 		{
-			return (StorageSize)(width * height * 0.4 / log(log(width * height + 16)));
+			switch (type)
+			{
+			case Image::Type::JPEG:
+				for (size_t i = 0; i < count; ++i)
+				{
+					sizes[i] = AbstractPyramid::PyramidSize(widths[i], heights[i], JPEG::LevelSize);
+				}
+				break;
+			case Image::Type::JPEG2000:
+				for (size_t i = 0; i < count; ++i)
+				{
+					sizes[i] = JPEG2000::ImageSize(widths[i], heights[i]);
+				}
+				break;
+			case Image::Type::BMP:
+				for (size_t i = 0; i < count; ++i)
+				{
+					sizes[i] = AbstractPyramid::PyramidSize(widths[i], heights[i], BMP::LevelSize);
+				}
+				break;
+			case Image::Type::UNKNOWN:
+			default:
+				throw std::invalid_argument("Unknown image type supplied to EstimateSizes");
+			}
 		}
 	}
 }
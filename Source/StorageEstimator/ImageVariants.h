@@ -37,7 +37,7 @@ namespace StorageEstimator
 			{}
 			~BMP() = default;
 
-			virtual StorageSize PyramidLevelSize(Image::Dimension width, Image::Dimension height) const override;
+			static StorageSize LevelSize(Image::Dimension width, Image::Dimension height);
 		};
 
 		class JPEG : public Image::AbstractPyramid
@@ -48,7 +48,7 @@ namespace StorageEstimator
 			{}
 			~JPEG() = default;
 
-			virtual StorageSize PyramidLevelSize(Image::Dimension width, Image::Dimension height) const override;
+			static StorageSize LevelSize(Image::Dimension width, Image::Dimension height);
 		};
 
 		class JPEG2000 : public Image::AbstractBase
@@ -59,7 +59,13 @@ namespace StorageEstimator
 			{}
 			~JPEG2000() = default;
 
-			virtual StorageSize Size() const override;
+			static StorageSize ImageSize(Image::Dimension width, Image::Dimension height);
 		};
+
+		// Computes sizes without allocating images, using the active CostModel if one is loaded.
+		// The type is resolved once per batch, which lets the built-in formulas inline into a tight loop.
+		StorageSize EstimateSize(Image::Type type, Image::Dimension width, Image::Dimension height);
+		void EstimateSizes(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count);
+		void EstimateSizesWithBuiltInFormulas(Image::Type type, const Image::Dimension* widths, const Image::Dimension* heights, StorageSize* sizes, size_t count);
 	}
 }
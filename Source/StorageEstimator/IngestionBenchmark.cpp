@@ -0,0 +1,104 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "IngestionBenchmark.h"
+#include "CombinedImageStack.h"
+
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+	using namespace StorageEstimator;
+
+	double IngestBatches(const std::vector<Image::DescriptionVector>& batches, SnapshotPublisher& publisher, size_t& snapshotsPublished)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		CombinedImageStack imageStack;
+		for (const auto& batch : batches)
+		{
+			imageStack.AddImages(batch);
+			publisher.Publish(imageStack.TakeSnapshot());
+			snapshotsPublished++;
+		}
+
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	}
+}
+
+namespace StorageEstimator
+{
+	std::string IngestionBenchmarkResult::ToString() const
+	{
+		auto imagesPerSecond = [this](double seconds) { return std::to_string((size_t)(seconds > 0.0 ? numberOfImages / seconds : 0.0)); };
+
+		return "\tIngested " + std::to_string(numberOfImages) + " images, publishing " + std::to_string(snapshotsPublished) + " snapshots per run\n"
+			+ "\tWithout reporter:\t" + std::to_string(secondsWithoutReporter) + " s (" + imagesPerSecond(secondsWithoutReporter) + " images/s)\n"
+			+ "\tWith reporter:\t\t" + std::to_string(secondsWithReporter) + " s (" + imagesPerSecond(secondsWithReporter) + " images/s), " + std::to_string(reportsRendered) + " reports rendered\n";
+	}
+
+	IngestionBenchmarkResult RunIngestionBenchmark(size_t numberOfImages, size_t imagesPerSnapshot)
+	{
+		// Generate the input up front so that both runs only measure ingestion
+		std::mt19937 random(2018);
+		std::uniform_int_distribution<int> drawType(0, 2);
+		std::uniform_int_distribution<Image::Dimension> drawDimension(64, 4096);
+
+		std::vector<Image::DescriptionVector> batches;
+		for (size_t added = 0; added < numberOfImages; added += imagesPerSnapshot)
+		{
+			Image::DescriptionVector batch(std::min(imagesPerSnapshot, numberOfImages - added));
+			for (auto& description : batch)
+			{
+				description.type = (Image::Type)drawType(random);
+				description.width = drawDimension(random);
+				description.height = drawDimension(random);
+			}
+
+			batches.push_back(std::move(batch));
+		}
+
+		IngestionBenchmarkResult result;
+		result.numberOfImages = numberOfImages;
+
+		SnapshotPublisher publisher;
+		result.secondsWithoutReporter = IngestBatches(batches, publisher, result.snapshotsPublished);
+
+		// The reporter renders whichever version is the latest, old versions are freed as soon
+		// as both the publisher and the reporter have moved past them
+		SnapshotPublisher reportedPublisher;
+		std::atomic<bool> ingesting(true);
+		size_t reportsRendered = 0;
+		std::thread reporter([&]
+		{
+			std::shared_ptr<const ImageStackSnapshot> lastReported;
+			while (ingesting)
+			{
+				std::shared_ptr<const ImageStackSnapshot> snapshot = reportedPublisher.Latest();
+				if (snapshot == lastReported)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				std::string report = snapshot->ToString();
+				if (!report.empty()) reportsRendered++;
+				lastReported = std::move(snapshot);
+			}
+		});
+
+		size_t snapshotsPublished = 0;
+		result.secondsWithReporter = IngestBatches(batches, reportedPublisher, snapshotsPublished);
+		ingesting = false;
+		reporter.join();
+
+		result.reportsRendered = reportsRendered;
+		return result;
+	}
+}
@@ -0,0 +1,26 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include <string>
+
+namespace StorageEstimator
+{
+	struct IngestionBenchmarkResult
+	{
+		size_t numberOfImages = 0;
+		double secondsWithoutReporter = 0.0;
+		double secondsWithReporter = 0.0;
+		size_t snapshotsPublished = 0;
+		size_t reportsRendered = 0;
+
+		std::string ToString() const;
+	};
+
+	// Adds random images to an empty CombinedImageStack twice, first alone and then while
+	// another thread keeps rendering the latest published snapshot
+	IngestionBenchmarkResult RunIngestionBenchmark(size_t numberOfImages, size_t imagesPerSnapshot = 10000);
+}
@@ -0,0 +1,211 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "Image.h"
+
+#include <stdexcept>
+
+namespace StorageEstimator
+{
+	// Entries ordered by (size, id) in a treap where every node knows the size of its subtree.
+	// Insert, Erase and SelectByRank run in O(log n), Largest(k) in O(log n + k).
+	template<typename Payload>
+	class OrderStatisticIndex
+	{
+	public:
+		struct Entry
+		{
+			StorageSize size;
+			Image::Id id;
+			Payload payload;
+		};
+
+	private:
+		struct Node
+		{
+			Entry entry;
+			unsigned int priority;
+			size_t subtreeCount = 1;
+			std::unique_ptr<Node> left;
+			std::unique_ptr<Node> right;
+
+			Node(const Entry& nodeEntry, unsigned int nodePriority)
+				: entry{ nodeEntry }, priority{ nodePriority }
+			{}
+		};
+		typedef std::unique_ptr<Node> NodePtr;
+
+		NodePtr root;
+		unsigned int prioritySeed = 2463534242u;
+
+	public:
+		OrderStatisticIndex() = default;
+		~OrderStatisticIndex() = default;
+
+		size_t Count() const
+		{
+			return SubtreeCount(root);
+		}
+
+		void Insert(StorageSize size, Image::Id id, const Payload& payload)
+		{
+			NodePtr less, greaterOrEqual;
+			Split(std::move(root), size, id, less, greaterOrEqual);
+
+			NodePtr node(new Node(Entry{ size, id, payload }, NextPriority()));
+			root = Merge(Merge(std::move(less), std::move(node)), std::move(greaterOrEqual));
+		}
+
+		bool Erase(StorageSize size, Image::Id id)
+		{
+			return EraseFromSubtree(root, size, id);
+		}
+
+		void Clear()
+		{
+			root.reset();
+		}
+
+		const Entry& SelectByRank(size_t rank) const
+		{
+			// rank 0 is the smallest entry
+			if (rank >= Count()) throw std::out_of_range("Rank outside OrderStatisticIndex");
+
+			const Node* node = root.get();
+			while (true)
+			{
+				size_t leftCount = SubtreeCount(node->left);
+				if (rank < leftCount)
+				{
+					node = node->left.get();
+				}
+				else if (rank == leftCount)
+				{
+					return node->entry;
+				}
+				else
+				{
+					rank -= leftCount + 1;
+					node = node->right.get();
+				}
+			}
+		}
+
+		std::vector<Entry> Largest(size_t count) const
+		{
+			// Reverse in-order walk which stops after count entries
+			std::vector<Entry> entries;
+			std::vector<const Node*> path;
+			const Node* node = root.get();
+
+			while ((node || !path.empty()) && entries.size() < count)
+			{
+				while (node)
+				{
+					path.push_back(node);
+					node = node->right.get();
+				}
+
+				node = path.back();
+				path.pop_back();
+				entries.push_back(node->entry);
+				node = node->left.get();
+			}
+
+			return entries;
+		}
+
+	private:
+		static size_t SubtreeCount(const NodePtr& node)
+		{
+			return node ? node->subtreeCount : 0;
+		}
+
+		static void UpdateCount(Node* node)
+		{
+			node->subtreeCount = 1 + SubtreeCount(node->left) + SubtreeCount(node->right);
+		}
+
+		static bool IsLess(StorageSize size, Image::Id id, StorageSize otherSize, Image::Id otherId)
+		{
+			return (size < otherSize) || (size == otherSize && id < otherId);
+		}
+
+		unsigned int NextPriority()
+		{
+			// xorshift32, the treap only needs priorities which are independent of the keys
+			prioritySeed ^= prioritySeed << 13;
+			prioritySeed ^= prioritySeed >> 17;
+			prioritySeed ^= prioritySeed << 5;
+			return prioritySeed;
+		}
+
+		static void Split(NodePtr node, StorageSize size, Image::Id id, NodePtr& less, NodePtr& greaterOrEqual)
+		{
+			if (!node)
+			{
+				less.reset();
+				greaterOrEqual.reset();
+			}
+			else if (IsLess(node->entry.size, node->entry.id, size, id))
+			{
+				Split(std::move(node->right), size, id, node->right, greaterOrEqual);
+				UpdateCount(node.get());
+				less = std::move(node);
+			}
+			else
+			{
+				Split(std::move(node->left), size, id, less, node->left);
+				UpdateCount(node.get());
+				greaterOrEqual = std::move(node);
+			}
+		}
+
+		static NodePtr Merge(NodePtr left, NodePtr right)
+		{
+			// Every key in left is smaller than every key in right
+			if (!left) return right;
+			if (!right) return left;
+
+			if (left->priority > right->priority)
+			{
+				left->right = Merge(std::move(left->right), std::move(right));
+				UpdateCount(left.get());
+				return left;
+			}
+			else
+			{
+				right->left = Merge(std::move(left), std::move(right->left));
+				UpdateCount(right.get());
+				return right;
+			}
+		}
+
+		static bool EraseFromSubtree(NodePtr& node, StorageSize size, Image::Id id)
+		{
+			if (!node) return false;
+
+			bool erased = false;
+			if (node->entry.size == size && node->entry.id == id)
+			{
+				node = Merge(std::move(node->left), std::move(node->right));
+				return true;
+			}
+			else if (IsLess(size, id, node->entry.size, node->entry.id))
+			{
+				erased = EraseFromSubtree(node->left, size, id);
+			}
+			else
+			{
+				erased = EraseFromSubtree(node->right, size, id);
+			}
+
+			if (erased) UpdateCount(node.get());
+			return erased;
+		}
+	};
+}
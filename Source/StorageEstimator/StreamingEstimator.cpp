@@ -0,0 +1,351 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "StreamingEstimator.h"
+#include "ImageVariants.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <iterator>
+
+namespace
+{
+	using namespace StorageEstimator;
+
+	const double confidenceFactor = 1.96;		// two standard errors, 95% confidence
+	const unsigned int maximumSamplingLevel = 63;
+
+	inline unsigned long long HashId(Image::Id id)
+	{
+		// splitmix64 finalizer, consecutive ids spread over the whole range
+		unsigned long long hash = id + 0x9E3779B97F4A7C15ull;
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		return hash ^ (hash >> 31);
+	}
+
+	inline size_t SizeBucket(StorageSize size)
+	{
+		// Index of the highest set bit, without a loop over the bits
+		size_t bucket = 0;
+		for (unsigned int shift : { 32u, 16u, 8u, 4u, 2u, 1u })
+		{
+			unsigned int step = ((size >> shift) != 0) ? shift : 0;
+			size >>= step;
+			bucket += step;
+		}
+		return bucket;
+	}
+}
+
+namespace StorageEstimator
+{
+	StorageSize StreamEstimate::EstimatedSize() const
+	{
+		return (StorageSize)std::llround(std::max(estimatedSize, 0.0));
+	}
+
+	StorageSize StreamEstimate::LowerBound() const
+	{
+		return (StorageSize)std::llround(std::max(estimatedSize - confidenceInterval, 0.0));
+	}
+
+	StorageSize StreamEstimate::UpperBound() const
+	{
+		return (StorageSize)std::llround(std::max(estimatedSize + confidenceInterval, 0.0));
+	}
+
+	StorageSize StreamEstimate::PercentileUpperBound(double percentile) const
+	{
+		size_t numberOfImages = std::accumulate(imagesBySizeBucket.begin(), imagesBySizeBucket.end(), (size_t)0);
+		size_t imagesBelow = 0;
+
+		for (size_t bucket = 0; bucket < numberOfSizeBuckets; ++bucket)
+		{
+			imagesBelow += imagesBySizeBucket[bucket];
+			if (imagesBelow > 0 && imagesBelow >= percentile / 100.0 * numberOfImages)
+			{
+				return (bucket + 1 < numberOfSizeBuckets) ? (2ull << bucket) - 1 : ~0ull;
+			}
+		}
+
+		return 0;
+	}
+
+	std::string StreamEstimate::ToString() const
+	{
+		std::string output = statistics.ToString();
+
+		for (size_t typeIndex = 0; typeIndex < imagesByType.size(); ++typeIndex)
+		{
+			std::string typeStr = Image::TypeToString((Image::Type)typeIndex);
+			std::string padding(10 - typeStr.size(), ' ');
+			output += "\t" + typeStr + padding + "\t" + std::to_string(imagesByType[typeIndex]) + " images\t" + StorageSizeToString(sizeByType[typeIndex]) + " bytes\n";
+		}
+
+		if (uncompressedSize > 0)
+		{
+			output += "\tHalf of the images are below " + StorageSizeToString(PercentileUpperBound(50.0)) + " bytes, 99% below " + StorageSizeToString(PercentileUpperBound(99.0)) + " bytes\n";
+		}
+
+		output += "\tWithout stack compression: " + StorageSizeToString(uncompressedSize) + " bytes\n";
+		output += "\tSampled " + std::to_string(sampledImages) + " images in " + std::to_string(sampledStacks) + " stacks, every image of " + StorageSizeToString(samplingThreshold) + " bytes or more\n";
+
+		if (confidenceInterval > 0.0)
+		{
+			output += "\t\tEstimated Total Size: " + StorageSizeToString(EstimatedSize()) + " bytes, 95% confidence interval " + StorageSizeToString(LowerBound()) + " - " + StorageSizeToString(UpperBound()) + " bytes\n";
+		}
+		else
+		{
+			output += "\t\tEstimated Total Size: " + StorageSizeToString(EstimatedSize()) + " bytes, every image was sampled\n";
+		}
+
+		return output;
+	}
+
+	std::string StreamEstimate::CompareWithExactSize(StorageSize exactSize) const
+	{
+		double difference = (double)EstimatedSize() - (double)exactSize;
+		double relativeDifference = (exactSize > 0) ? 100.0 * difference / exactSize : 0.0;
+		bool isInsideInterval = (LowerBound() <= exactSize && exactSize <= UpperBound());
+
+		return "\tExact Total Size: " + StorageSizeToString(exactSize) + " bytes, the estimate differs by " + std::to_string((long long)difference)
+			+ " bytes (" + std::to_string(relativeDifference) + "%) and the exact size is " + (isInsideInterval ? "inside" : "outside") + " the interval\n";
+	}
+
+	StreamingEstimator::StreamingEstimator(const StreamSettings& streamSettings)
+		: settings{ streamSettings }
+	{
+		settings.maximumSampledImages = std::max<size_t>(settings.maximumSampledImages, 1);
+		sampledImages.reserve(settings.maximumSampledImages + 1);
+	}
+
+	void StreamingEstimator::AddImages(const Image::DescriptionVector& descriptions)
+	{
+		// Sizes are computed per type in batches, then taken in id order
+		for (auto& batch : typeBatches)
+		{
+			batch.widths.clear();
+			batch.heights.clear();
+			batch.positions.clear();
+		}
+
+		for (size_t position = 0; position < descriptions.size(); ++position)
+		{
+			const Image::Description& description = descriptions[position];
+			TypeBatch& batch = typeBatches[(size_t)description.type];
+			batch.widths.push_back(description.width);
+			batch.heights.push_back(description.height);
+			batch.positions.push_back(position);
+		}
+
+		batchSizes.resize(descriptions.size());
+		for (size_t typeIndex = 0; typeIndex < typeBatches.size(); ++typeIndex)
+		{
+			TypeBatch& batch = typeBatches[typeIndex];
+			if (batch.positions.empty()) continue;
+
+			batch.sizes.resize(batch.positions.size());
+			Image::EstimateSizes((Image::Type)typeIndex, batch.widths.data(), batch.heights.data(), batch.sizes.data(), batch.sizes.size());
+
+			StorageSize typeSize = 0;
+			for (size_t i = 0; i < batch.positions.size(); ++i)
+			{
+				batchSizes[batch.positions[i]] = batch.sizes[i];
+				typeSize += batch.sizes[i];
+			}
+
+			totals.imagesByType[typeIndex] += batch.positions.size();
+			totals.sizeByType[typeIndex] += typeSize;
+			totals.uncompressedSize += typeSize;
+		}
+
+		for (StorageSize size : batchSizes)
+		{
+			Image::Id id = ++numberOfImages;
+			totals.imagesBySizeBucket[SizeBucket(size)]++;
+
+			if (!IsSampled(id, size)) continue;
+
+			sampledImages[id].size = size;
+			if (sampledImages.size() > settings.maximumSampledImages) RaiseSamplingLevel();
+		}
+	}
+
+	void StreamingEstimator::AddStacks(const std::vector<ImageIdRanges>& stacksOfImageIds)
+	{
+		for (const auto& ranges : stacksOfImageIds)
+		{
+			Image::Id stackId = ++numberOfStacks;
+
+			size_t numberOfImagesInStack = 0;
+			for (const auto& range : ranges)
+			{
+				numberOfImagesInStack += (size_t)range.second - range.first + 1;
+			}
+
+			// Visits the sampled members either through the ids of the stack or, for stacks larger
+			// than the sample, by looking up every sampled image in the ranges
+			if (numberOfImagesInStack <= sampledImages.size())
+			{
+				for (const auto& range : ranges)
+				{
+					for (unsigned long long id = range.first; id <= range.second; ++id)
+					{
+						auto imageIter = sampledImages.find((Image::Id)id);
+						if (imageIter != sampledImages.end()) MoveSampledImage(imageIter->second, stackId, numberOfImagesInStack);
+					}
+				}
+			}
+			else
+			{
+				for (auto& sampledImage : sampledImages)
+				{
+					Image::Id id = sampledImage.first;
+					auto rangeIter = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(id, ~(Image::Id)0));
+					if (rangeIter != ranges.begin() && std::prev(rangeIter)->second >= id)
+					{
+						MoveSampledImage(sampledImage.second, stackId, numberOfImagesInStack);
+					}
+				}
+			}
+		}
+	}
+
+	StreamEstimate StreamingEstimator::Estimate() const
+	{
+		struct SampledStackTotals
+		{
+			size_t numberOfSampledImages = 0;
+			double numberOfImagesLeft = 0.0;		// taken by later stacks
+			double uncompressedSize = 0.0;
+			double savedFraction = 0.0;
+		};
+
+		StreamEstimate estimate = totals;
+		estimate.samplingThreshold = 1ull << samplingLevel;
+		estimate.sampledImages = sampledImages.size();
+
+		// A sampled image stands for 1 / probability images, which estimates both the images a
+		// stack has lost to later stacks and its uncompressed size
+		std::unordered_map<Image::Id, SampledStackTotals> stackTotals;
+		for (const auto& sampledImage : sampledImages)
+		{
+			const SampledImage& image = sampledImage.second;
+			double weight = 1.0 / InclusionProbability(image.size);
+
+			for (Image::Id previousStackId : image.previousStackIds)
+			{
+				stackTotals[previousStackId].numberOfImagesLeft += weight;
+			}
+
+			if (image.stackId == 0) continue;
+
+			SampledStackTotals& stack = stackTotals[image.stackId];
+			stack.numberOfSampledImages++;
+			stack.uncompressedSize += weight * image.size;
+		}
+
+		for (auto& stackTotal : stackTotals)
+		{
+			SampledStackTotals& sample = stackTotal.second;
+			if (sample.numberOfSampledImages == 0 || sample.uncompressedSize <= 0.0) continue;
+
+			const SampledStack& stack = sampledStacks.at(stackTotal.first);
+			double numberOfImagesInStack = std::max((double)stack.numberOfImages - sample.numberOfImagesLeft, (double)sample.numberOfSampledImages);
+
+			StorageSize compressedSize = Image::Stack::CompressedSize((StorageSize)std::llround(sample.uncompressedSize), (size_t)std::llround(numberOfImagesInStack));
+			sample.savedFraction = 1.0 - (double)compressedSize / sample.uncompressedSize;
+			estimate.sampledStacks++;
+		}
+
+		// The saved size is a Horvitz-Thompson sum over the sampled images in stacks, whose
+		// variance gives the confidence interval
+		double savedSize = 0.0;
+		double variance = 0.0;
+
+		for (const auto& sampledImage : sampledImages)
+		{
+			const SampledImage& image = sampledImage.second;
+			if (image.stackId == 0) continue;
+
+			double probability = InclusionProbability(image.size);
+			double weightedSavedSize = image.size * stackTotals[image.stackId].savedFraction / probability;
+
+			savedSize += weightedSavedSize;
+			variance += (1.0 - probability) * weightedSavedSize * weightedSavedSize;
+		}
+
+		estimate.estimatedSize = (double)totals.uncompressedSize - savedSize;
+		estimate.confidenceInterval = confidenceFactor * std::sqrt(variance);
+		return estimate;
+	}
+
+	bool StreamingEstimator::IsSampled(Image::Id id, StorageSize size) const
+	{
+		// The top samplingLevel bits of the hash are uniform below the threshold
+		return samplingLevel == 0 || (HashId(id) >> (64 - samplingLevel)) < std::max<StorageSize>(size, 1);
+	}
+
+	double StreamingEstimator::InclusionProbability(StorageSize size) const
+	{
+		return std::min(1.0, std::ldexp((double)std::max<StorageSize>(size, 1), -(int)samplingLevel));
+	}
+
+	void StreamingEstimator::RaiseSamplingLevel()
+	{
+		// Doubling the threshold keeps each sampled image with probability 1/2 or more
+		while (sampledImages.size() > settings.maximumSampledImages && samplingLevel < maximumSamplingLevel)
+		{
+			samplingLevel++;
+
+			for (auto imageIter = sampledImages.begin(); imageIter != sampledImages.end();)
+			{
+				const SampledImage& image = imageIter->second;
+				if (IsSampled(imageIter->first, image.size))
+				{
+					++imageIter;
+					continue;
+				}
+
+				if (image.stackId != 0) ReleaseSampledStack(image.stackId);
+				for (Image::Id previousStackId : image.previousStackIds)
+				{
+					ReleaseSampledStack(previousStackId);
+				}
+
+				imageIter = sampledImages.erase(imageIter);
+			}
+		}
+	}
+
+	void StreamingEstimator::MoveSampledImage(SampledImage& image, Image::Id stackId, size_t numberOfImagesInStack)
+	{
+		// Like CombinedImageStack::AddStack, an image in another stack is taken from it
+		if (image.stackId != 0) image.previousStackIds.push_back(image.stackId);
+
+		SampledStack& stack = sampledStacks[stackId];
+		stack.numberOfImages = numberOfImagesInStack;
+		stack.references++;
+		image.stackId = stackId;
+	}
+
+	void StreamingEstimator::ReleaseSampledStack(Image::Id stackId)
+	{
+		auto stackIter = sampledStacks.find(stackId);
+		if (--stackIter->second.references == 0) sampledStacks.erase(stackIter);
+	}
+
+	StreamEstimate EstimateCommandStream(const std::string& filePath, const StreamSettings& settings)
+	{
+		StreamingEstimator estimator(settings);
+		CommandStreamStatistics statistics = ReadCommandStream(filePath, estimator);
+
+		StreamEstimate estimate = estimator.Estimate();
+		estimate.statistics = statistics;
+		return estimate;
+	}
+}
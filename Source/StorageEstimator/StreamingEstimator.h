@@ -0,0 +1,101 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include "CommandStream.h"
+
+#include <array>
+#include <unordered_map>
+
+namespace StorageEstimator
+{
+	struct StreamSettings
+	{
+		size_t maximumSampledImages = 1 << 16;		// bounds the memory used for stack compression
+	};
+
+	struct StreamEstimate
+	{
+		static constexpr size_t numberOfSizeBuckets = 64;
+
+		CommandStreamStatistics statistics;
+		std::array<size_t, (size_t)Image::Type::UNKNOWN> imagesByType = {};
+		std::array<StorageSize, (size_t)Image::Type::UNKNOWN> sizeByType = {};
+		std::array<size_t, numberOfSizeBuckets> imagesBySizeBucket = {};		// bucket b holds sizes in [2^b, 2^(b+1)), bucket 0 also 0
+		StorageSize uncompressedSize = 0;		// exact, every image at full size
+		double estimatedSize = 0.0;
+		double confidenceInterval = 0.0;		// half width at 95% confidence, 0 when every image was sampled
+		StorageSize samplingThreshold = 1;		// smaller images are sampled with probability size / threshold
+		size_t sampledImages = 0;
+		size_t sampledStacks = 0;
+
+		StorageSize EstimatedSize() const;
+		StorageSize LowerBound() const;
+		StorageSize UpperBound() const;
+		StorageSize PercentileUpperBound(double percentile) const;
+		std::string ToString() const;
+		std::string CompareWithExactSize(StorageSize exactSize) const;
+	};
+
+	// Estimates the total size of a command stream in bounded memory. Image sizes are summed
+	// exactly with the active size models, while stack compression is estimated from a sample of
+	// the images. An image is sampled with probability size / threshold, decided by the hash of
+	// its id, so the large images which dominate the total are always kept. The threshold is
+	// doubled whenever the sample outgrows its budget, which keeps a subset of the same sample.
+	class StreamingEstimator : public CommandStreamHandler
+	{
+	private:
+		struct SampledImage
+		{
+			StorageSize size = 0;
+			Image::Id stackId = 0;		// 0 outside stacks
+			std::vector<Image::Id> previousStackIds;
+		};
+
+		struct SampledStack
+		{
+			size_t numberOfImages = 0;		// when the stack was added, before later stacks took any
+			size_t references = 0;		// sampled images which are or have been in the stack
+		};
+
+		struct TypeBatch
+		{
+			std::vector<Image::Dimension> widths;
+			std::vector<Image::Dimension> heights;
+			std::vector<size_t> positions;
+			std::vector<StorageSize> sizes;
+		};
+
+		StreamSettings settings;
+		StreamEstimate totals;
+		Image::Id numberOfImages = 0;
+		Image::Id numberOfStacks = 0;
+		unsigned int samplingLevel = 0;		// the sampling threshold is 2^samplingLevel bytes
+		std::unordered_map<Image::Id, SampledImage> sampledImages;
+		std::unordered_map<Image::Id, SampledStack> sampledStacks;
+		std::array<TypeBatch, (size_t)Image::Type::UNKNOWN> typeBatches;
+		std::vector<StorageSize> batchSizes;
+
+	public:
+		StreamingEstimator(const StreamSettings& streamSettings);
+		~StreamingEstimator() = default;
+
+		void AddImages(const Image::DescriptionVector& descriptions) override;
+		void AddStacks(const std::vector<ImageIdRanges>& stacksOfImageIds) override;
+		StreamEstimate Estimate() const;
+
+	private:
+		bool IsSampled(Image::Id id, StorageSize size) const;
+		double InclusionProbability(StorageSize size) const;
+		void RaiseSamplingLevel();
+		void MoveSampledImage(SampledImage& image, Image::Id stackId, size_t numberOfImagesInStack);
+		void ReleaseSampledStack(Image::Id stackId);
+	};
+
+	// Reads the file once through a StreamingEstimator.
+	// Throws std::invalid_argument if the file can not be opened.
+	StreamEstimate EstimateCommandStream(const std::string& filePath, const StreamSettings& settings);
+}
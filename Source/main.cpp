@@ -1,222 +1,861 @@
-/*
-	Copyright Denny Lindberg 2018
-	www.dennylindberg.com
-*/
-
-#include <string>
-#include <vector>
-#include <regex>
-
-#include "ConsoleUtils.h"
-#include "StorageEstimator/CombinedImageStack.h"
-
-using namespace StorageEstimator;
-
-typedef std::vector<std::string> InputParameters;
-enum class InputCommand { NoInput, EndProcess, AddImageStack, AddImageType, Unknown };
-enum class InputResponse { Failed, Success };
-
-void SplitStringToCommandAndParameters(const std::string& userInputStr, std::string& commandStr, InputParameters& parameters);
-void SplitStringUsingRegex(const std::string& str, std::vector<std::string>& stringTokens, const std::regex expression);
-InputCommand InterpretStringAsCommand(std::string command);
-InputResponse AttemptToAddImageFromInput(const std::string& userInputImageTypeStr, const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
-InputResponse AttemptToAddImageStackFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
-
-int main()
-{
-	std::cout << 
-R"(######################################################################
-
-	Storage calculator by Denny Lindberg
-
-	Enter one line for each image/group using the formats: 
-		"type width height"
-		"G i, i, ..." 
-		
-		Exit with "Q"
-
-######################################################################
-
-)";
-
-	StorageEstimator::CombinedImageStack storageEstimator;
-
-	std::string userInputStr;
-	std::string commandStr;
-	InputParameters parameters;
-	InputCommand command = InputCommand::NoInput;
-	InputResponse response = InputResponse::Failed;
-
-	while (command != InputCommand::EndProcess)
-	{
-		// Fetch input
-		PrintLine("Add image/group: ");
-		std::getline(std::cin, userInputStr);
-		SplitStringToCommandAndParameters(userInputStr, commandStr, parameters);
-
-		// Evaluate command
-		command = InterpretStringAsCommand(commandStr);
-		switch (command)
-		{
-		case InputCommand::NoInput:
-		case InputCommand::EndProcess:
-			response = InputResponse::Success;
-			break;
-
-		case InputCommand::AddImageStack:
-			response = AttemptToAddImageStackFromInput(parameters, storageEstimator);
-			break;
-
-		case InputCommand::AddImageType:
-			response = AttemptToAddImageFromInput(commandStr, parameters, storageEstimator);
-			break;
-
-		case InputCommand::Unknown:
-		default:
-			PrintWarning("The input [" + commandStr + "] is not a valid command.");
-			response = InputResponse::Failed;
-			break;
-		}
-
-		// Print updated contents
-		if (response == InputResponse::Success && command != InputCommand::EndProcess)
-		{
-			PrintLine(storageEstimator.ToString());
-		}
-	} 
-
-    return 0;
-}
-
-void SplitStringToCommandAndParameters(const std::string& userInputStr, std::string& commandStr, InputParameters& parameters)
-{
-	std::vector<std::string> inputStrTokens;
-	SplitStringUsingRegex(userInputStr, inputStrTokens, std::regex("\\s+")); // match whitespaces
-	
-	// Get command in upper case form (allow both upper/lower case)
-	commandStr = inputStrTokens[0];
-	std::transform(commandStr.begin(), commandStr.end(), commandStr.begin(), ::toupper);
-
-	if (inputStrTokens.size() > 1)
-	{
-		parameters.assign(inputStrTokens.begin() + 1, inputStrTokens.end());
-	}
-	else
-	{
-		parameters.clear();
-	}
-}
-
-void SplitStringUsingRegex(const std::string& str, std::vector<std::string>& stringTokens, const std::regex expression)
-{
-	std::sregex_token_iterator tokensBegin(str.begin(), str.end(), expression, -1);
-	std::sregex_token_iterator tokensEnd;
-	stringTokens.assign(tokensBegin, tokensEnd);
-}
-
-InputCommand InterpretStringAsCommand(std::string command)
-{
-	if (command == "") return InputCommand::NoInput;
-
-	std::vector<std::string> validCommands = {
-		"Q",				// Quit (end of input)
-		"G",				// Image Group (stack)
-		"J", "JPG", "JPEG", // Image types
-		"JP2", "JPEG2000",
-		"BMP"
-	};
-
-	auto elementIter = std::find(validCommands.begin(), validCommands.end(), command);
-
-	if (elementIter == validCommands.end())			return InputCommand::Unknown;
-	else if (*elementIter == validCommands[0])		return InputCommand::EndProcess;
-	else if (*elementIter == validCommands[1])		return InputCommand::AddImageStack;
-	else											return InputCommand::AddImageType;
-}
-
-InputResponse AttemptToAddImageFromInput(const std::string& userInputImageTypeStr, const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
-{
-	std::string internalImageType(userInputImageTypeStr);
-	if (userInputImageTypeStr == "J" || userInputImageTypeStr == "JPG")
-	{
-		internalImageType = "JPEG";
-	}
-	else if (userInputImageTypeStr == "JP2")
-	{
-		internalImageType = "JPEG2000";
-	}
-
-	Image::Type imageType = Image::TypeToEnum(internalImageType);
-
-	if (imageType == Image::Type::UNKNOWN)
-	{
-		PrintWarning("The input [" + userInputImageTypeStr + "] is an unknown image type.");
-	}
-	else if (parameters.size() != 2)
-	{
-		PrintWarning("Invalid image dimensions. Type the command in this form: [" + userInputImageTypeStr + " width height]");
-	}
-	else
-	{
-		int width = std::stoi(parameters[0]);
-		int height = std::stoi(parameters[1]);
-
-		if (width < 0 || height < 0)
-		{
-			PrintWarning("Image dimensions must have positive values!");
-		}
-		else
-		{
-			storageEstimator.AddImage(imageType, abs(width), abs(height));
-			return InputResponse::Success;
-		}
-	}
-
-	return InputResponse::Failed;
-}
-
-InputResponse AttemptToAddImageStackFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
-{
-	if (parameters.size() == 0)
-	{
-		PrintWarning("You must supply at least one image id to the image group: [G i, i, ...]");
-		return InputResponse::Failed;
-	}
-	else
-	{
-		std::vector<Image::Id> imageIds(0);
-
-		// Extract ids from parameters
-		for (const auto& param : parameters)
-		{
-			try
-			{
-				int id = std::stoi(param);
-				int arrayIndex = id - 1;
-				if (arrayIndex < 0 || arrayIndex >= storageEstimator.NumberOfImages())
-				{
-					PrintWarning("" + param + " does not match any of the images.");
-					return InputResponse::Failed;
-				}
-
-				imageIds.push_back(abs(id));
-			}
-			catch (...)
-			{
-				PrintWarning("'" + param + "' is not a valid parameter.");
-				return InputResponse::Failed;
-			}
-		}
-
-		if (imageIds.size() <= 1)
-		{
-			PrintWarning("You must add at least two images to a group.");
-			return InputResponse::Failed;
-		}
-		else
-		{
-			storageEstimator.AddStack(imageIds);
-			return InputResponse::Success;
-		}
-	}
-}
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <functional>
+
+#include "ConsoleUtils.h"
+#include "StorageEstimator/CombinedImageStack.h"
+#include "StorageEstimator/DirectoryScanner.h"
+#include "StorageEstimator/CapacityProjection.h"
+#include "StorageEstimator/IngestionBenchmark.h"
+#include "StorageEstimator/CostModel.h"
+#include "StorageEstimator/StreamingEstimator.h"
+
+using namespace StorageEstimator;
+
+typedef std::vector<std::string> InputParameters;
+enum class InputCommand { NoInput, EndProcess, AddImageStack, AddImageStacks, AddImageType, RemoveImages, UngroupStacks, ScanDirectory, ProjectCapacity, ListLargest, ListByType, FindPercentile, ExportSnapshot, RunBenchmark, LoadCostModel, StreamFile, Unknown };
+enum class InputResponse { Failed, Success };
+
+void SplitStringToCommandAndParameters(const std::string& userInputStr, std::string& commandStr, InputParameters& parameters);
+void SplitStringOnDelimiters(const std::string& str, std::vector<std::string>& stringTokens, const std::string& delimiters);
+std::string JoinParameters(const InputParameters& parameters);
+InputCommand InterpretStringAsCommand(std::string command);
+bool CommandChangesEstimate(InputCommand command);
+InputResponse AttemptToAddImageFromInput(const std::string& userInputImageTypeStr, const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToAddImageStackFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToAddImageStacksFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToRemoveImagesFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToUngroupStacksFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse ParseImageIdsFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<Image::Id>& imageIds);
+InputResponse ParseStackIdsFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<Image::Id>& stackIds);
+InputResponse ParseIdsFromInput(const InputParameters& parameters, Image::Id highestId, const std::function<bool(Image::Id)>& isKnownId, const std::string& itemName, std::vector<Image::Id>& ids);
+InputResponse AttemptToScanDirectoryFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToProjectCapacityFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToListLargestFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse ListTotalsByType(const StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToFindPercentileFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToExportSnapshotFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<std::thread>& exportThreads);
+InputResponse AttemptToRunBenchmarkFromInput(const InputParameters& parameters);
+InputResponse AttemptToLoadCostModelFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator);
+InputResponse AttemptToStreamFileFromInput(const InputParameters& parameters);
+
+// Larger estimates only print totals, listing every image would flood the console
+const size_t maximumImagesToList = 1000;
+
+int main()
+{
+	std::cout << 
+R"(######################################################################
+
+	Storage calculator by Denny Lindberg
+
+	Enter one line for each image/group using the formats: 
+		"type width height"
+		"G i, i, ..." 
+		
+		Groups accept id ranges, "G 100-199, 250", and several groups can
+		be added at once with "GROUPS 1-10; 11-20; ..."
+		Remove images with "REMOVE i, i-j" and split stacks with "UNGROUP s, s-t"
+		Add all images in a directory tree with "SCAN path [GROUP]"
+		Project future sizes with "PROJECT imagesPerDay days, days, ..."
+		Query with "TOP n", "BYTYPE" and "PERCENTILE p"
+		Write the current state to a file in the background with "EXPORT path"
+		Load size formulas with "MODEL path", restore them with "MODEL DEFAULT"
+		and compare a model with the built-in formulas with "MODEL CHECK"
+		Estimate the total of a large command file in bounded memory with
+		"STREAM path [SAMPLE n] [VERIFY]"
+		Exit with "Q"
+
+######################################################################
+
+)";
+
+	StorageEstimator::CombinedImageStack storageEstimator;
+	std::vector<std::thread> exportThreads;
+
+	std::string userInputStr;
+	std::string commandStr;
+	InputParameters parameters;
+	InputCommand command = InputCommand::NoInput;
+	InputResponse response = InputResponse::Failed;
+
+	while (command != InputCommand::EndProcess)
+	{
+		// Fetch input
+		PrintLine("Add image/group: ");
+		std::getline(std::cin, userInputStr);
+		SplitStringToCommandAndParameters(userInputStr, commandStr, parameters);
+
+		// Evaluate command
+		command = InterpretStringAsCommand(commandStr);
+		switch (command)
+		{
+		case InputCommand::NoInput:
+		case InputCommand::EndProcess:
+			response = InputResponse::Success;
+			break;
+
+		case InputCommand::AddImageStack:
+			response = AttemptToAddImageStackFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::AddImageStacks:
+			response = AttemptToAddImageStacksFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::AddImageType:
+			response = AttemptToAddImageFromInput(commandStr, parameters, storageEstimator);
+			break;
+
+		case InputCommand::RemoveImages:
+			response = AttemptToRemoveImagesFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::UngroupStacks:
+			response = AttemptToUngroupStacksFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::ScanDirectory:
+			response = AttemptToScanDirectoryFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::ProjectCapacity:
+			response = AttemptToProjectCapacityFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::ListLargest:
+			response = AttemptToListLargestFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::ListByType:
+			response = ListTotalsByType(storageEstimator);
+			break;
+
+		case InputCommand::FindPercentile:
+			response = AttemptToFindPercentileFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::ExportSnapshot:
+			response = AttemptToExportSnapshotFromInput(parameters, storageEstimator, exportThreads);
+			break;
+
+		case InputCommand::RunBenchmark:
+			response = AttemptToRunBenchmarkFromInput(parameters);
+			break;
+
+		case InputCommand::LoadCostModel:
+			response = AttemptToLoadCostModelFromInput(parameters, storageEstimator);
+			break;
+
+		case InputCommand::StreamFile:
+			response = AttemptToStreamFileFromInput(parameters);
+			break;
+
+		case InputCommand::Unknown:
+		default:
+			PrintWarning("The input [" + commandStr + "] is not a valid command.");
+			response = InputResponse::Failed;
+			break;
+		}
+
+		// Print updated contents
+		if (response == InputResponse::Success && CommandChangesEstimate(command))
+		{
+			if (storageEstimator.NumberOfImages() > maximumImagesToList)
+			{
+				PrintLine(storageEstimator.SummaryToString());
+			}
+			else
+			{
+				PrintLine(storageEstimator.ToString());
+			}
+		}
+	} 
+
+	// Let unfinished exports complete before exiting
+	for (auto& exportThread : exportThreads)
+	{
+		exportThread.join();
+	}
+
+    return 0;
+}
+
+void SplitStringToCommandAndParameters(const std::string& userInputStr, std::string& commandStr, InputParameters& parameters)
+{
+	std::vector<std::string> inputStrTokens;
+	SplitStringOnDelimiters(userInputStr, inputStrTokens, " \t\r\n");
+	
+	// Get command in upper case form (allow both upper/lower case)
+	commandStr = inputStrTokens.empty() ? "" : inputStrTokens[0];
+	std::transform(commandStr.begin(), commandStr.end(), commandStr.begin(), ::toupper);
+
+	if (inputStrTokens.size() > 1)
+	{
+		parameters.assign(inputStrTokens.begin() + 1, inputStrTokens.end());
+	}
+	else
+	{
+		parameters.clear();
+	}
+}
+
+void SplitStringOnDelimiters(const std::string& str, std::vector<std::string>& stringTokens, const std::string& delimiters)
+{
+	// Empty tokens are skipped. A plain scan is used since group lines can hold many thousand ids.
+	stringTokens.clear();
+
+	size_t tokenStart = str.find_first_not_of(delimiters);
+	while (tokenStart != std::string::npos)
+	{
+		size_t tokenEnd = str.find_first_of(delimiters, tokenStart);
+		stringTokens.push_back(str.substr(tokenStart, tokenEnd - tokenStart));
+		tokenStart = str.find_first_not_of(delimiters, tokenEnd);
+	}
+}
+
+std::string JoinParameters(const InputParameters& parameters)
+{
+	std::string joined;
+	for (const auto& parameter : parameters)
+	{
+		if (!joined.empty()) joined += " ";
+		joined += parameter;
+	}
+
+	return joined;
+}
+
+InputCommand InterpretStringAsCommand(std::string command)
+{
+	if (command == "") return InputCommand::NoInput;
+
+	std::vector<std::string> validCommands = {
+		"Q",				// Quit (end of input)
+		"G",				// Image Group (stack)
+		"GROUPS",			// Several image groups
+		"J", "JPG", "JPEG", // Image types
+		"JP2", "JPEG2000",
+		"BMP",
+		"REMOVE",			// Image removal
+		"UNGROUP",			// Image Group removal, keeping the images
+		"SCAN",				// Directory tree
+		"PROJECT",			// Capacity projection
+		"TOP", "BYTYPE",	// Queries
+		"PERCENTILE",
+		"EXPORT",			// Background report
+		"BENCHMARK",		// Ingestion with a concurrent reporter
+		"MODEL",			// Size formulas
+		"STREAM"			// Estimate of a command file
+	};
+
+	auto elementIter = std::find(validCommands.begin(), validCommands.end(), command);
+
+	if (elementIter == validCommands.end())			return InputCommand::Unknown;
+	else if (*elementIter == validCommands[0])		return InputCommand::EndProcess;
+	else if (*elementIter == validCommands[1])		return InputCommand::AddImageStack;
+	else if (*elementIter == "GROUPS")				return InputCommand::AddImageStacks;
+	else if (*elementIter == "REMOVE")				return InputCommand::RemoveImages;
+	else if (*elementIter == "UNGROUP")				return InputCommand::UngroupStacks;
+	else if (*elementIter == "SCAN")				return InputCommand::ScanDirectory;
+	else if (*elementIter == "PROJECT")				return InputCommand::ProjectCapacity;
+	else if (*elementIter == "TOP")					return InputCommand::ListLargest;
+	else if (*elementIter == "BYTYPE")				return InputCommand::ListByType;
+	else if (*elementIter == "PERCENTILE")			return InputCommand::FindPercentile;
+	else if (*elementIter == "EXPORT")				return InputCommand::ExportSnapshot;
+	else if (*elementIter == "BENCHMARK")			return InputCommand::RunBenchmark;
+	else if (*elementIter == "MODEL")				return InputCommand::LoadCostModel;
+	else if (*elementIter == "STREAM")				return InputCommand::StreamFile;
+	else											return InputCommand::AddImageType;
+}
+
+bool CommandChangesEstimate(InputCommand command)
+{
+	switch (command)
+	{
+	case InputCommand::AddImageStack:
+	case InputCommand::AddImageStacks:
+	case InputCommand::AddImageType:
+	case InputCommand::RemoveImages:
+	case InputCommand::UngroupStacks:
+	case InputCommand::ScanDirectory:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+InputResponse AttemptToAddImageFromInput(const std::string& userInputImageTypeStr, const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	std::string internalImageType(userInputImageTypeStr);
+	if (userInputImageTypeStr == "J" || userInputImageTypeStr == "JPG")
+	{
+		internalImageType = "JPEG";
+	}
+	else if (userInputImageTypeStr == "JP2")
+	{
+		internalImageType = "JPEG2000";
+	}
+
+	Image::Type imageType = Image::TypeToEnum(internalImageType);
+
+	if (imageType == Image::Type::UNKNOWN)
+	{
+		PrintWarning("The input [" + userInputImageTypeStr + "] is an unknown image type.");
+	}
+	else if (parameters.size() != 2)
+	{
+		PrintWarning("Invalid image dimensions. Type the command in this form: [" + userInputImageTypeStr + " width height]");
+	}
+	else
+	{
+		int width = std::stoi(parameters[0]);
+		int height = std::stoi(parameters[1]);
+
+		if (width < 0 || height < 0)
+		{
+			PrintWarning("Image dimensions must have positive values!");
+		}
+		else
+		{
+			storageEstimator.AddImage(imageType, abs(width), abs(height));
+			return InputResponse::Success;
+		}
+	}
+
+	return InputResponse::Failed;
+}
+
+InputResponse AttemptToAddImageStackFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply at least one image id to the image group: [G i, i, ...]");
+		return InputResponse::Failed;
+	}
+	else
+	{
+		std::vector<Image::Id> imageIds(0);
+		if (ParseImageIdsFromInput(parameters, storageEstimator, imageIds) == InputResponse::Failed)
+		{
+			return InputResponse::Failed;
+		}
+
+		if (imageIds.size() <= 1)
+		{
+			PrintWarning("You must add at least two images to a group.");
+			return InputResponse::Failed;
+		}
+		else
+		{
+			storageEstimator.AddStack(imageIds);
+			return InputResponse::Success;
+		}
+	}
+}
+
+InputResponse AttemptToAddImageStacksFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	std::vector<std::string> groupStrs;
+	SplitStringOnDelimiters(JoinParameters(parameters), groupStrs, ";");
+
+	if (groupStrs.size() == 0)
+	{
+		PrintWarning("You must supply at least one image group: [GROUPS i, i-j; i, i-j; ...]");
+		return InputResponse::Failed;
+	}
+
+	std::vector<std::vector<Image::Id>> stacksOfImageIds;
+	stacksOfImageIds.reserve(groupStrs.size());
+
+	for (const auto& groupStr : groupStrs)
+	{
+		InputParameters groupParameters;
+		SplitStringOnDelimiters(groupStr, groupParameters, " \t");
+
+		std::vector<Image::Id> imageIds;
+		if (ParseImageIdsFromInput(groupParameters, storageEstimator, imageIds) == InputResponse::Failed)
+		{
+			return InputResponse::Failed;
+		}
+
+		if (imageIds.size() <= 1)
+		{
+			PrintWarning("You must add at least two images to each group: [" + groupStr + "]");
+			return InputResponse::Failed;
+		}
+
+		stacksOfImageIds.push_back(std::move(imageIds));
+	}
+
+	storageEstimator.AddStacks(stacksOfImageIds);
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToRemoveImagesFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply at least one image id to remove: [REMOVE i, i-j, ...]");
+		return InputResponse::Failed;
+	}
+
+	std::vector<Image::Id> imageIds;
+	if (ParseImageIdsFromInput(parameters, storageEstimator, imageIds) == InputResponse::Failed)
+	{
+		return InputResponse::Failed;
+	}
+
+	size_t removedImages = 0;
+	for (auto id : imageIds)
+	{
+		if (storageEstimator.RemoveImageById(id)) removedImages++;
+	}
+
+	PrintLine("\tRemoved " + std::to_string(removedImages) + " images\n");
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToUngroupStacksFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply at least one stack id to ungroup: [UNGROUP s, s-t, ...]");
+		return InputResponse::Failed;
+	}
+
+	std::vector<Image::Id> stackIds;
+	if (ParseStackIdsFromInput(parameters, storageEstimator, stackIds) == InputResponse::Failed)
+	{
+		return InputResponse::Failed;
+	}
+
+	size_t ungroupedStacks = 0;
+	for (auto id : stackIds)
+	{
+		if (storageEstimator.UngroupStack(id)) ungroupedStacks++;
+	}
+
+	PrintLine("\tUngrouped " + std::to_string(ungroupedStacks) + " stacks\n");
+	return InputResponse::Success;
+}
+
+InputResponse ParseImageIdsFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<Image::Id>& imageIds)
+{
+	auto isKnownImage = [&storageEstimator](Image::Id id) { return storageEstimator.ContainsImage(id); };
+	return ParseIdsFromInput(parameters, storageEstimator.HighestImageId(), isKnownImage, "images", imageIds);
+}
+
+InputResponse ParseStackIdsFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<Image::Id>& stackIds)
+{
+	auto isKnownStack = [&storageEstimator](Image::Id id) { return storageEstimator.ContainsStack(id); };
+	return ParseIdsFromInput(parameters, storageEstimator.HighestStackId(), isKnownStack, "stacks", stackIds);
+}
+
+InputResponse ParseIdsFromInput(const InputParameters& parameters, Image::Id highestId, const std::function<bool(Image::Id)>& isKnownId, const std::string& itemName, std::vector<Image::Id>& ids)
+{
+	// Accepts single ids and ranges "first-last", separated by whitespace or commas. A single
+	// id must be known, while ranges skip ids which have been removed.
+	auto parseId = [](const std::string& idStr, Image::Id& id) {
+		if (idStr.empty() || idStr.find_first_not_of("0123456789") != std::string::npos) return false;
+		try
+		{
+			unsigned long long value = std::stoull(idStr);
+			id = (Image::Id)value;
+			return (value == id);
+		}
+		catch (...)
+		{
+			return false;
+		}
+	};
+
+	std::vector<std::string> idStrs;
+	for (const auto& param : parameters)
+	{
+		SplitStringOnDelimiters(param, idStrs, ",");
+
+		for (const auto& idStr : idStrs)
+		{
+			size_t rangeSeparator = idStr.find('-');
+			bool isRange = (rangeSeparator != std::string::npos);
+
+			Image::Id firstId = 0;
+			Image::Id lastId = 0;
+			bool isValid = isRange
+				? parseId(idStr.substr(0, rangeSeparator), firstId) && parseId(idStr.substr(rangeSeparator + 1), lastId)
+				: parseId(idStr, firstId);
+			if (!isRange) lastId = firstId;
+
+			if (!isValid || firstId > lastId)
+			{
+				PrintWarning("'" + idStr + "' is not a valid parameter.");
+				return InputResponse::Failed;
+			}
+
+			if (firstId < 1 || lastId > highestId || (!isRange && !isKnownId(firstId)))
+			{
+				PrintWarning("" + idStr + " does not match any of the " + itemName + ".");
+				return InputResponse::Failed;
+			}
+
+			for (Image::Id id = firstId; id <= lastId && id != 0; ++id)
+			{
+				if (isKnownId(id)) ids.push_back(id);
+			}
+		}
+	}
+
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToScanDirectoryFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply a directory to scan: [SCAN path] or [SCAN path GROUP]");
+		return InputResponse::Failed;
+	}
+
+	ScanSettings settings;
+	InputParameters pathTokens(parameters);
+
+	std::string lastParameter = pathTokens.back();
+	std::transform(lastParameter.begin(), lastParameter.end(), lastParameter.begin(), ::toupper);
+	if (lastParameter == "GROUP" && pathTokens.size() > 1)
+	{
+		settings.groupImagesBySubdirectory = true;
+		pathTokens.pop_back();
+	}
+
+	// Rejoin the tokens to allow paths containing spaces
+	std::string directory = pathTokens[0];
+	for (size_t i = 1; i < pathTokens.size(); ++i)
+	{
+		directory += " " + pathTokens[i];
+	}
+
+	try
+	{
+		ScanResult result = DirectoryScanner(settings).Scan(directory, storageEstimator);
+		PrintLine(result.ToString());
+		return InputResponse::Success;
+	}
+	catch (const std::invalid_argument& error)
+	{
+		PrintWarning(error.what());
+		return InputResponse::Failed;
+	}
+}
+
+InputResponse AttemptToProjectCapacityFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	if (parameters.size() < 2)
+	{
+		PrintWarning("You must supply the daily ingest and at least one horizon: [PROJECT imagesPerDay days, days, ...]");
+		return InputResponse::Failed;
+	}
+
+	ProjectionSettings settings;
+	try
+	{
+		settings.imagesPerDay = std::stod(parameters[0]);
+		for (size_t i = 1; i < parameters.size(); ++i)
+		{
+			int days = std::stoi(parameters[i]);
+			if (days <= 0)
+			{
+				PrintWarning("Horizons must be at least one day.");
+				return InputResponse::Failed;
+			}
+
+			settings.horizonDays.push_back(days);
+		}
+	}
+	catch (...)
+	{
+		PrintWarning("Projection parameters must be numbers: [PROJECT imagesPerDay days, days, ...]");
+		return InputResponse::Failed;
+	}
+
+	if (settings.imagesPerDay < 0.0)
+	{
+		PrintWarning("The daily ingest can not be negative.");
+		return InputResponse::Failed;
+	}
+
+	try
+	{
+		CapacityProjection projection(IngestModel::FromImageStack(storageEstimator));
+		PrintLine(projection.Run(storageEstimator.Size(), settings).ToString());
+		return InputResponse::Success;
+	}
+	catch (const std::invalid_argument& error)
+	{
+		PrintWarning(error.what());
+		return InputResponse::Failed;
+	}
+}
+
+InputResponse AttemptToListLargestFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	int count = 0;
+	try
+	{
+		if (parameters.size() == 1) count = std::stoi(parameters[0]);
+	}
+	catch (...)
+	{}
+
+	if (count <= 0)
+	{
+		PrintWarning("You must supply how many images and stacks to list: [TOP n]");
+		return InputResponse::Failed;
+	}
+
+	std::string output = "\tLargest images:\n";
+	for (const auto& image : storageEstimator.LargestImages(count))
+	{
+		output += "\t" + image->ToString() + "\n";
+	}
+
+	output += "\n\tLargest stacks:\n";
+	for (const auto& stack : storageEstimator.LargestStacks(count))
+	{
+		output += "\t" + stack.ToString() + "\n";
+	}
+
+	PrintLine(output);
+	return InputResponse::Success;
+}
+
+InputResponse ListTotalsByType(const StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	std::string output = "\tSizes before stack compression:\n";
+
+	const Image::Type types[] = { Image::Type::JPEG, Image::Type::JPEG2000, Image::Type::BMP };
+	for (auto type : types)
+	{
+		const TypeStatistics& statistics = storageEstimator.StatisticsForType(type);
+		std::string typeStr = Image::TypeToString(type);
+		std::string padding(10 - typeStr.size(), ' ');
+		output += "\t" + typeStr + padding + "\t" + std::to_string(statistics.numberOfImages) + " images\t" + StorageSizeToString(statistics.totalSize) + " bytes\n";
+	}
+
+	PrintLine(output);
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToFindPercentileFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	double percentile = -1.0;
+	try
+	{
+		if (parameters.size() == 1) percentile = std::stod(parameters[0]);
+	}
+	catch (...)
+	{}
+
+	if (percentile < 0.0 || percentile > 100.0)
+	{
+		PrintWarning("You must supply a percentile between 0 and 100: [PERCENTILE p]");
+		return InputResponse::Failed;
+	}
+
+	std::string output;
+
+	Image::SharedPtr image;
+	if (storageEstimator.FindImageAtPercentile(percentile, image))
+	{
+		output += "\tImage:\t" + image->ToString() + "\n";
+	}
+	else
+	{
+		output += "\tNo images\n";
+	}
+
+	StackSummary stack;
+	if (storageEstimator.FindStackAtPercentile(percentile, stack))
+	{
+		output += "\tStack:\t" + stack.ToString() + "\n";
+	}
+	else
+	{
+		output += "\tNo image stacks\n";
+	}
+
+	PrintLine(output);
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToExportSnapshotFromInput(const InputParameters& parameters, const StorageEstimator::CombinedImageStack& storageEstimator, std::vector<std::thread>& exportThreads)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply a file to export to: [EXPORT path]");
+		return InputResponse::Failed;
+	}
+
+	// Rejoin the tokens to allow paths containing spaces
+	std::string filePath = parameters[0];
+	for (size_t i = 1; i < parameters.size(); ++i)
+	{
+		filePath += " " + parameters[i];
+	}
+
+	std::ofstream file(filePath);
+	if (!file)
+	{
+		PrintWarning("Could not open '" + filePath + "' for writing.");
+		return InputResponse::Failed;
+	}
+
+	// The snapshot stays consistent while new input keeps changing the estimate
+	ImageStackSnapshot snapshot = storageEstimator.TakeSnapshot();
+	exportThreads.emplace_back([snapshot](std::ofstream exportFile) {
+		exportFile << snapshot.ToString();
+	}, std::move(file));
+
+	PrintLine("\tExporting " + std::to_string(snapshot.NumberOfImages()) + " images to '" + filePath + "' in the background\n");
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToRunBenchmarkFromInput(const InputParameters& parameters)
+{
+	int numberOfImages = 0;
+	try
+	{
+		if (parameters.size() == 1) numberOfImages = std::stoi(parameters[0]);
+	}
+	catch (...)
+	{}
+
+	if (numberOfImages <= 0)
+	{
+		PrintWarning("You must supply how many images to ingest: [BENCHMARK n]");
+		return InputResponse::Failed;
+	}
+
+	PrintLine(RunIngestionBenchmark(numberOfImages).ToString());
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToLoadCostModelFromInput(const InputParameters& parameters, StorageEstimator::CombinedImageStack& storageEstimator)
+{
+	std::shared_ptr<const CostModel> activeModel = CostModel::Active();
+	CostModel builtInModel;
+
+	std::string argument = JoinParameters(parameters);
+	std::string keyword(argument);
+	std::transform(keyword.begin(), keyword.end(), keyword.begin(), ::toupper);
+
+	if (argument.empty())
+	{
+		PrintLine((activeModel ? *activeModel : builtInModel).ToString());
+		return InputResponse::Success;
+	}
+	else if (keyword == "CHECK")
+	{
+		PrintLine(CompareWithBuiltInFormulas(activeModel ? *activeModel : builtInModel, 1000000).ToString());
+		return InputResponse::Success;
+	}
+	else if (keyword == "DEFAULT")
+	{
+		CostModel::ActivateBuiltIn();
+		PrintLine(builtInModel.ToString());
+	}
+	else
+	{
+		try
+		{
+			CostModel model = CostModel::FromFile(argument);
+			CostModel::Activate(model);
+			PrintLine(model.ToString());
+		}
+		catch (const std::invalid_argument& error)
+		{
+			PrintWarning(error.what());
+			return InputResponse::Failed;
+		}
+	}
+
+	// Every cached size was computed with the previous model
+	storageEstimator.RecomputeSizes();
+	PrintLine(storageEstimator.SummaryToString());
+	return InputResponse::Success;
+}
+
+InputResponse AttemptToStreamFileFromInput(const InputParameters& parameters)
+{
+	if (parameters.size() == 0)
+	{
+		PrintWarning("You must supply a file of image and group lines: [STREAM path] or [STREAM path SAMPLE n VERIFY]");
+		return InputResponse::Failed;
+	}
+
+	StreamSettings settings;
+	bool verify = false;
+	InputParameters pathTokens(parameters);
+
+	// Options follow the path, which may contain spaces
+	while (pathTokens.size() > 1)
+	{
+		std::string lastParameter = pathTokens.back();
+		std::string optionParameter = pathTokens[pathTokens.size() - 2];
+		std::transform(lastParameter.begin(), lastParameter.end(), lastParameter.begin(), ::toupper);
+		std::transform(optionParameter.begin(), optionParameter.end(), optionParameter.begin(), ::toupper);
+
+		if (lastParameter == "VERIFY")
+		{
+			verify = true;
+			pathTokens.pop_back();
+		}
+		else if (optionParameter == "SAMPLE" && pathTokens.size() > 2)
+		{
+			if (lastParameter.empty() || lastParameter.find_first_not_of("0123456789") != std::string::npos || lastParameter.size() > 18 || std::stoull(lastParameter) == 0)
+			{
+				PrintWarning("The sample size must be a positive number of images: [STREAM path SAMPLE n]");
+				return InputResponse::Failed;
+			}
+
+			settings.maximumSampledImages = (size_t)std::stoull(lastParameter);
+			pathTokens.resize(pathTokens.size() - 2);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	std::string filePath = JoinParameters(pathTokens);
+
+	try
+	{
+		StreamEstimate estimate = EstimateCommandStream(filePath, settings);
+		PrintLine(estimate.ToString());
+
+		if (verify)
+		{
+			StorageEstimator::CombinedImageStack exactEstimator;
+			ExactStreamHandler exactHandler(exactEstimator);
+			CommandStreamStatistics statistics = ReadCommandStream(filePath, exactHandler);
+
+			PrintLine("	Exact replay took " + std::to_string(statistics.seconds) + " s\n" + estimate.CompareWithExactSize(exactEstimator.Size()));
+		}
+
+		return InputResponse::Success;
+	}
+	catch (const std::invalid_argument& error)
+	{
+		PrintWarning(error.what());
+		return InputResponse::Failed;
+	}
+}
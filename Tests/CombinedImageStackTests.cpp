@@ -0,0 +1,50 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "TestFramework.h"
+#include "StorageEstimator/CombinedImageStack.h"
+
+using namespace StorageEstimator;
+
+namespace
+{
+	std::vector<Image::Id> IdRange(Image::Id firstId, Image::Id lastId)
+	{
+		std::vector<Image::Id> ids;
+		for (Image::Id id = firstId; id <= lastId; ++id) ids.push_back(id);
+		return ids;
+	}
+}
+
+TEST_CASE(GroupingEveryLooseImageCompactsTheLooseImages)
+{
+	CombinedImageStack combinedStack;
+	for (int i = 0; i < 1000; ++i) combinedStack.AddImage(Image::Type::JPEG, 100 + i, 100);
+
+	StorageSize uncompressedSize = combinedStack.Size();
+	combinedStack.AddStack(IdRange(1, 1000));
+
+	CHECK(combinedStack.NumberOfImageSlots() == 0);
+	CHECK(combinedStack.NumberOfImages() == 1000);
+	CHECK(combinedStack.NumberOfStacks() == 1);
+	CHECK(combinedStack.Size() == Image::Stack::CompressedSize(uncompressedSize, 1000));
+	CHECK(combinedStack.ImageDescriptions().size() == 1000);
+	CHECK(combinedStack.ContainsImage(1) && combinedStack.ContainsImage(1000));
+}
+
+TEST_CASE(RemovingMostLooseImagesCompactsTheLooseImages)
+{
+	CombinedImageStack combinedStack;
+	for (int i = 0; i < 1000; ++i) combinedStack.AddImage(Image::Type::BMP, 10, 10);
+
+	for (Image::Id id = 1; id <= 900; ++id) CHECK(combinedStack.RemoveImageById(id));
+
+	CHECK(combinedStack.NumberOfImages() == 100);
+	CHECK(combinedStack.NumberOfImageSlots() < 1000);
+	CHECK(combinedStack.Size() == 100 * 10 * 10);
+	CHECK(!combinedStack.ContainsImage(900));
+	CHECK(combinedStack.RemoveImageById(1000));
+	CHECK(combinedStack.NumberOfImages() == 99);
+}
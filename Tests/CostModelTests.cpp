@@ -0,0 +1,117 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "TestFramework.h"
+#include "StorageEstimator/CombinedImageStack.h"
+#include "StorageEstimator/CostModel.h"
+#include "StorageEstimator/ImageVariants.h"
+
+#include <random>
+
+using namespace StorageEstimator;
+
+namespace
+{
+	const Image::Type imageTypes[] = { Image::Type::JPEG, Image::Type::JPEG2000, Image::Type::BMP };
+}
+
+TEST_CASE(SingleSizesMatchBlockSizes)
+{
+	CostModel model = CostModel::FromString("JPEG pyramid = sqrt(width * height) * (level + 1) - min(width, 7)\nSTACK = uncompressed / pow(2, count)", "test");
+	const Image::Dimension widths[] = { 0, 1, 255, 256, 4000, 65535, 100000 };
+	const Image::Dimension heights[] = { 0, 300, 255, 1024, 3000, 65535, 70000 };
+	const size_t count = sizeof(widths) / sizeof(widths[0]);
+
+	for (auto type : imageTypes)
+	{
+		StorageSize sizes[count];
+		model.ImageSizes(type, widths, heights, sizes, count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			CHECK(model.ImageSize(type, widths[i], heights[i]) == sizes[i]);
+		}
+	}
+
+	CHECK(model.StackSize(1 << 20, 4) == (1 << 16));
+	CHECK(CostModel().StackSize(1 << 20, 4) == Image::Stack::CompressedSizeWithBuiltInFormula(1 << 20, 4));
+}
+
+TEST_CASE(PyramidsOfSimilarAndMixedSizesMatchSingleSizes)
+{
+	// Blocks of similar images are evaluated level by level, blocks mixing thumbnails with
+	// huge images image by image
+	CostModel model = CostModel::FromString("JPEG pyramid = width * height * 0.2 + level\nBMP pyramid = width * height", "test");
+	std::mt19937 random(2018);
+	std::uniform_int_distribution<Image::Dimension> drawDimension(0, 65535);
+
+	std::vector<Image::Dimension> widths;
+	std::vector<Image::Dimension> heights;
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		widths.push_back(drawDimension(random));
+		heights.push_back(drawDimension(random));
+	}
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		bool isHuge = (i % 16 == 0);
+		widths.push_back(isHuge ? 1u << 31 : 100);
+		heights.push_back(isHuge ? 4000000000u : 90);
+	}
+
+	std::vector<StorageSize> sizes(widths.size());
+	for (auto type : { Image::Type::JPEG, Image::Type::BMP })
+	{
+		model.ImageSizes(type, widths.data(), heights.data(), sizes.data(), sizes.size());
+
+		size_t numberOfDifferentSizes = 0;
+		for (size_t i = 0; i < sizes.size(); ++i)
+		{
+			if (sizes[i] != model.ImageSize(type, widths[i], heights[i])) numberOfDifferentSizes++;
+		}
+		CHECK(numberOfDifferentSizes == 0);
+	}
+}
+
+TEST_CASE(ReplacedModelsAreReleased)
+{
+	CostModel::Activate(CostModel::FromString("BMP image = 1", "first"));
+	std::weak_ptr<const CostModel> firstModel = CostModel::Active();
+	std::shared_ptr<const CostModel> heldModel = CostModel::Active();
+
+	CostModel::Activate(CostModel::FromString("BMP image = 2", "second"));
+	CHECK(!firstModel.expired());
+	CHECK(heldModel->ImageSize(Image::Type::BMP, 10, 10) == 1);
+	CHECK(Image::EstimateSize(Image::Type::BMP, 10, 10) == 2);
+
+	heldModel.reset();
+	CHECK(firstModel.expired());
+
+	CostModel::ActivateBuiltIn();
+	CHECK(!CostModel::Active());
+	CHECK(Image::EstimateSize(Image::Type::BMP, 10, 10) == 100);
+}
+
+TEST_CASE(SnapshotsKeepTheSizesOfTheirModel)
+{
+	CostModel::ActivateBuiltIn();
+	CombinedImageStack combinedStack;
+	combinedStack.AddImage(Image::Type::BMP, 100, 100);
+	combinedStack.AddImage(Image::Type::BMP, 200, 100);
+	combinedStack.AddImage(Image::Type::JPEG2000, 300, 300);
+	combinedStack.AddStack({ 1, 2 });
+
+	ImageStackSnapshot snapshot = combinedStack.TakeSnapshot();
+	std::string snapshotText = snapshot.ToString();
+
+	CostModel::Activate(CostModel::FromString("BMP image = 1\nJPEG2000 image = 2\nSTACK = uncompressed * 1000", "test"));
+	CHECK(snapshot.ToString() == snapshotText);
+
+	combinedStack.RecomputeSizes();
+	CHECK(combinedStack.Size() == 2000 + 2);
+	CHECK(snapshot.ToString() == snapshotText);
+	CHECK(snapshot.Size() == Image::Stack::CompressedSizeWithBuiltInFormula(100 * 100 + 200 * 100, 2) + Image::JPEG2000::ImageSize(300, 300));
+
+	CostModel::ActivateBuiltIn();
+}
@@ -0,0 +1,226 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "TestFramework.h"
+#include "StorageEstimator/DirectoryScanner.h"
+#include "StorageEstimator/ImageHeaders.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+using namespace StorageEstimator;
+
+namespace
+{
+	typedef std::vector<unsigned char> Bytes;
+
+	// Unique directory below the system temp directory, removed with everything in it
+	class TemporaryDirectory
+	{
+	private:
+		std::filesystem::path path;
+
+	public:
+		TemporaryDirectory()
+		{
+			std::random_device random;
+			path = std::filesystem::temp_directory_path() / ("ImageStorageEstimatorTests-" + std::to_string(random()) + std::to_string(random()));
+			std::filesystem::create_directories(path);
+		}
+		~TemporaryDirectory()
+		{
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		const std::filesystem::path& Path() const { return path; }
+	};
+
+	void AppendBigEndian(Bytes& bytes, unsigned int value, size_t numberOfBytes)
+	{
+		for (size_t i = numberOfBytes; i-- > 0;) bytes.push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	void AppendLittleEndian(Bytes& bytes, unsigned int value, size_t numberOfBytes)
+	{
+		for (size_t i = 0; i < numberOfBytes; ++i) bytes.push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	Bytes JPEGHeader(unsigned int width, unsigned int height)
+	{
+		// SOI, an APP0 segment to skip, then SOF0 with precision, height and width
+		Bytes bytes = { 0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x06, 'J', 'F', 'I', 'F', 0xFF, 0xC0, 0x00, 0x11, 0x08 };
+		AppendBigEndian(bytes, height, 2);
+		AppendBigEndian(bytes, width, 2);
+		bytes.insert(bytes.end(), 10, 0);
+		return bytes;
+	}
+
+	Bytes JP2Header(unsigned int width, unsigned int height)
+	{
+		// Signature box, a file type box to skip, then the jp2h superbox holding ihdr
+		Bytes bytes = { 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A };
+		AppendBigEndian(bytes, 20, 4);
+		bytes.insert(bytes.end(), { 'f', 't', 'y', 'p', 'j', 'p', '2', ' ', 0, 0, 0, 0, 'j', 'p', '2', ' ' });
+		AppendBigEndian(bytes, 30, 4);
+		bytes.insert(bytes.end(), { 'j', 'p', '2', 'h' });
+		AppendBigEndian(bytes, 22, 4);
+		bytes.insert(bytes.end(), { 'i', 'h', 'd', 'r' });
+		AppendBigEndian(bytes, height, 4);
+		AppendBigEndian(bytes, width, 4);
+		bytes.insert(bytes.end(), 6, 0);
+		return bytes;
+	}
+
+	Bytes J2KCodestreamHeader(unsigned int gridWidth, unsigned int gridHeight, unsigned int offsetX, unsigned int offsetY)
+	{
+		// SOC followed by the SIZ marker segment
+		Bytes bytes = { 0xFF, 0x4F, 0xFF, 0x51, 0x00, 0x29, 0x00, 0x00 };
+		AppendBigEndian(bytes, gridWidth, 4);
+		AppendBigEndian(bytes, gridHeight, 4);
+		AppendBigEndian(bytes, offsetX, 4);
+		AppendBigEndian(bytes, offsetY, 4);
+		bytes.insert(bytes.end(), 20, 0);
+		return bytes;
+	}
+
+	Bytes BMPHeader(int width, int height)
+	{
+		// File header followed by a BITMAPINFOHEADER
+		Bytes bytes = { 'B', 'M' };
+		bytes.insert(bytes.end(), 12, 0);
+		AppendLittleEndian(bytes, 40, 4);
+		AppendLittleEndian(bytes, (unsigned int)width, 4);
+		AppendLittleEndian(bytes, (unsigned int)height, 4);
+		bytes.insert(bytes.end(), 28, 0);
+		return bytes;
+	}
+
+	Bytes BMPCoreHeader(unsigned int width, unsigned int height)
+	{
+		Bytes bytes = { 'B', 'M' };
+		bytes.insert(bytes.end(), 12, 0);
+		AppendLittleEndian(bytes, 12, 4);
+		AppendLittleEndian(bytes, width, 2);
+		AppendLittleEndian(bytes, height, 2);
+		bytes.insert(bytes.end(), 4, 0);
+		return bytes;
+	}
+
+	void WriteFile(const std::filesystem::path& filePath, const Bytes& bytes)
+	{
+		std::filesystem::create_directories(filePath.parent_path());
+		std::ofstream file(filePath, std::ios::binary);
+		file.write((const char*)bytes.data(), bytes.size());
+	}
+
+	bool ReadHeader(const std::filesystem::path& filePath, const Bytes& bytes, Image::Description& description)
+	{
+		WriteFile(filePath, bytes);
+		return Image::ReadDescriptionFromHeader(filePath.string(), description);
+	}
+
+	bool HasDescription(const Image::Description& description, Image::Type type, Image::Dimension width, Image::Dimension height)
+	{
+		return description.type == type && description.width == width && description.height == height;
+	}
+}
+
+TEST_CASE(HeadersOfEverySupportedFormatAreParsed)
+{
+	TemporaryDirectory directory;
+	Image::Description description;
+
+	CHECK(ReadHeader(directory.Path() / "a.jpg", JPEGHeader(640, 480), description));
+	CHECK(HasDescription(description, Image::Type::JPEG, 640, 480));
+
+	CHECK(ReadHeader(directory.Path() / "b.jp2", JP2Header(4000, 3000), description));
+	CHECK(HasDescription(description, Image::Type::JPEG2000, 4000, 3000));
+
+	CHECK(ReadHeader(directory.Path() / "c.j2k", J2KCodestreamHeader(1100, 900, 100, 50), description));
+	CHECK(HasDescription(description, Image::Type::JPEG2000, 1000, 850));
+
+	CHECK(ReadHeader(directory.Path() / "d.bmp", BMPHeader(320, -200), description));
+	CHECK(HasDescription(description, Image::Type::BMP, 320, 200));
+
+	CHECK(ReadHeader(directory.Path() / "e.bmp", BMPCoreHeader(64, 32), description));
+	CHECK(HasDescription(description, Image::Type::BMP, 64, 32));
+}
+
+TEST_CASE(TruncatedAndUnrecognisedFilesAreRejected)
+{
+	TemporaryDirectory directory;
+	Image::Description description;
+
+	Bytes truncatedJPEG = JPEGHeader(640, 480);
+	truncatedJPEG.resize(14);
+	CHECK(!ReadHeader(directory.Path() / "truncated.jpg", truncatedJPEG, description));
+
+	Bytes truncatedJP2 = JP2Header(640, 480);
+	truncatedJP2.resize(40);
+	CHECK(!ReadHeader(directory.Path() / "truncated.jp2", truncatedJP2, description));
+
+	CHECK(!ReadHeader(directory.Path() / "notes.txt", Bytes{ 'h', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd', '\n' }, description));
+	CHECK(!ReadHeader(directory.Path() / "empty.bmp", BMPHeader(0, 100), description));
+	CHECK(!ReadHeader(directory.Path() / "negative.bmp", BMPHeader(-5, 100), description));
+	CHECK(!Image::ReadDescriptionFromHeader((directory.Path() / "missing.jpg").string(), description));
+}
+
+TEST_CASE(ScanCountsAddedAndSkippedFiles)
+{
+	TemporaryDirectory directory;
+	WriteFile(directory.Path() / "a.jpg", JPEGHeader(640, 480));
+	WriteFile(directory.Path() / "b.bmp", BMPHeader(100, 100));
+	WriteFile(directory.Path() / "readme.txt", Bytes{ 'x' });
+	WriteFile(directory.Path() / "sub" / "c.jp2", JP2Header(200, 100));
+	WriteFile(directory.Path() / "sub" / "d.jp2", JP2Header(300, 100));
+	WriteFile(directory.Path() / "sub" / "e.jpg", Bytes{ 0xFF, 0xD8, 0xFF });
+	WriteFile(directory.Path() / "other" / "f.jpg", JPEGHeader(10, 10));
+
+	ScanSettings settings;
+	settings.numberOfThreads = 2;
+	settings.filesPerBatch = 1;
+
+	CombinedImageStack target;
+	ScanResult result = DirectoryScanner(settings).Scan(directory.Path().string(), target);
+
+	CHECK(result.filesVisited == 7);
+	CHECK(result.imagesAdded == 5);
+	CHECK(result.stacksAdded == 0);
+	CHECK(target.NumberOfImages() == 5);
+	CHECK(target.StatisticsForType(Image::Type::JPEG2000).numberOfImages == 2);
+	CHECK(result.ToString().find("skipped 2 files") != std::string::npos);
+
+	// Grouping stacks every directory with two or more images, "other" has only one
+	settings.groupImagesBySubdirectory = true;
+	CombinedImageStack groupedTarget;
+	ScanResult groupedResult = DirectoryScanner(settings).Scan(directory.Path().string(), groupedTarget);
+
+	CHECK(groupedResult.imagesAdded == 5);
+	CHECK(groupedResult.stacksAdded == 2);
+	CHECK(groupedTarget.NumberOfStacks() == 2);
+	CHECK(groupedTarget.NumberOfImages() == 5);
+}
+
+TEST_CASE(ScanOfMissingDirectoryThrows)
+{
+	TemporaryDirectory directory;
+	CombinedImageStack target;
+
+	bool hasThrown = false;
+	try
+	{
+		DirectoryScanner(ScanSettings()).Scan((directory.Path() / "missing").string(), target);
+	}
+	catch (const std::invalid_argument&)
+	{
+		hasThrown = true;
+	}
+
+	CHECK(hasThrown);
+	CHECK(target.NumberOfImages() == 0);
+}
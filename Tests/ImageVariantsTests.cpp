@@ -0,0 +1,35 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "TestFramework.h"
+#include "StorageEstimator/ImageVariants.h"
+
+#include <cmath>
+
+using namespace StorageEstimator;
+
+TEST_CASE(SizesOfSmallImagesFollowTheFormulas)
+{
+	CHECK(Image::BMP::LevelSize(100, 50) == 5000);
+	CHECK(Image::JPEG::LevelSize(100, 50) == 1000);
+	CHECK(Image::EstimateSize(Image::Type::BMP, 256, 256) == 256 * 256 + 128 * 128);
+	CHECK(Image::EstimateSize(Image::Type::JPEG, 100, 100) == 2000);
+	CHECK(Image::EstimateSize(Image::Type::JPEG2000, 100, 100) == (StorageSize)(100 * 100 * 0.4 / log(log(100 * 100 + 16))));
+}
+
+TEST_CASE(SizesOfImagesAbove32BitPixelCountsDoNotWrap)
+{
+	// 100000 x 100000 pixels is above 2^32
+	const Image::Dimension side = 100000;
+	const StorageSize numberOfPixels = 10000000000ull;
+
+	CHECK(Image::BMP::LevelSize(side, side) == numberOfPixels);
+	CHECK(Image::JPEG::LevelSize(side, side) == (StorageSize)(numberOfPixels * 0.2));
+	CHECK(Image::JPEG2000::ImageSize(side, side) == (StorageSize)(numberOfPixels * 0.4 / log(log(numberOfPixels + 16))));
+	CHECK(Image::EstimateSize(Image::Type::BMP, side, side) > numberOfPixels);
+
+	const Image::Dimension largestSide = 2147483647;
+	CHECK(Image::BMP::LevelSize(largestSide, largestSide) == (StorageSize)largestSide * largestSide);
+}
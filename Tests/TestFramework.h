@@ -0,0 +1,42 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/*
+	Minimal test registry. Each TEST_CASE registers itself before main runs, and CHECK
+	records a failure without stopping the test.
+*/
+namespace Tests
+{
+	struct TestCase
+	{
+		std::string name;
+		std::function<void()> function;
+	};
+
+	std::vector<TestCase>& RegisteredTests();
+	void ReportFailure(const std::string& expression, const char* file, int line);
+
+	struct TestRegistration
+	{
+		TestRegistration(const std::string& name, std::function<void()> function)
+		{
+			RegisteredTests().push_back(TestCase{ name, function });
+		}
+	};
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static Tests::TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Tests::ReportFailure(#expression, __FILE__, __LINE__); } while (false)
@@ -0,0 +1,54 @@
+/*
+	Copyright Denny Lindberg 2018
+	www.dennylindberg.com
+*/
+
+#include "TestFramework.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	size_t failuresInCurrentTest = 0;
+}
+
+namespace Tests
+{
+	std::vector<TestCase>& RegisteredTests()
+	{
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+
+	void ReportFailure(const std::string& expression, const char* file, int line)
+	{
+		failuresInCurrentTest++;
+		std::cout << "\t" << file << "(" << line << "): CHECK(" << expression << ") failed\n";
+	}
+}
+
+int main()
+{
+	size_t failedTests = 0;
+
+	for (const auto& test : Tests::RegisteredTests())
+	{
+		failuresInCurrentTest = 0;
+
+		try
+		{
+			test.function();
+		}
+		catch (const std::exception& error)
+		{
+			Tests::ReportFailure(std::string("unexpected exception: ") + error.what(), __FILE__, __LINE__);
+		}
+
+		std::cout << (failuresInCurrentTest == 0 ? "[PASS] " : "[FAIL] ") << test.name << "\n";
+		if (failuresInCurrentTest > 0) failedTests++;
+	}
+
+	std::cout << "\n" << Tests::RegisteredTests().size() - failedTests << " of " << Tests::RegisteredTests().size() << " tests passed\n";
+	return (failedTests == 0) ? 0 : 1;
+}
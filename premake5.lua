@@ -4,6 +4,7 @@
 
 local binaries_folder = "Binaries/"
 local source_folder = "Source/"
+local tests_folder = "Tests/"
 local ide_project_folder = "Temporary/"
 local binary_target_dir = (binaries_folder .. "%{cfg.platform}")
 
@@ -54,4 +55,19 @@ project(projectName)
 
     linkoptions (LinkOptionsForPDBandIlkCleanup(projectName))
 
-    files { source_folder .. "**.h", source_folder .. "**.cpp" }
\ No newline at end of file
+    files { source_folder .. "**.h", source_folder .. "**.cpp" }
+
+
+
+-- TESTS
+local testProjectName = "ImageStorageEstimatorTests"
+project(testProjectName)
+    kind "ConsoleApp"
+    location(ide_project_folder)
+    targetname(testProjectName)
+    targetdir(binary_target_dir)
+
+    linkoptions (LinkOptionsForPDBandIlkCleanup(testProjectName))
+
+    includedirs { source_folder }
+    files { tests_folder .. "**.h", tests_folder .. "**.cpp", source_folder .. "StorageEstimator/**.h", source_folder .. "StorageEstimator/**.cpp" }